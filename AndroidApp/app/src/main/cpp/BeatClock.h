@@ -0,0 +1,152 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRUMMACHINE_BEATCLOCK_H
+#define DRUMMACHINE_BEATCLOCK_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "DrumMachineConstants.h"
+
+constexpr int64_t kTempoResolution = 1000; // tempo is tracked in 1/1000 bpm
+constexpr int32_t kTempoRampUpdateFrames = 64; // longest span rendered at one tempo during a ramp
+constexpr int kMaxTempoRampBeats = 256; // keeps the ramp interpolation well within int64_t
+
+/**
+ * Fixed-point playback position shared by the audio thread, the pattern compiler and the JNI calls.
+ *
+ * The position is counted in ticks, and a beat is 60 * sampleRate * kTempoResolution ticks long.
+ * Every frame advances the clock by tempo * kTempoResolution ticks, so frames per beat is exact for
+ * any tempo and no rounding error builds up, however long the session. Beats always sit on whole
+ * ticks. A beat which falls between two frames is played on the nearest one, the remainder is kept
+ * in the position instead of being thrown away.
+ *
+ * Since positions don't depend on the tempo, changing it keeps the musical position, and a ramp
+ * only has to step the per-frame increment as the clock advances.
+ */
+class BeatClock {
+public:
+    static constexpr int64_t ticksPerBeat(int32_t sampleRate) {
+        return 60 * static_cast<int64_t>(sampleRate) * kTempoResolution;
+    }
+
+    explicit BeatClock(int32_t sampleRate = kDefaultSampleRateHz)
+            : mTicksPerBeat(ticksPerBeat(sampleRate)) {}
+
+    /**
+     * Change the rate frames are counted at, only while stopped. Positions are rate dependent, so
+     * the position goes back to 0 and any ramp is cancelled.
+     */
+    void setSampleRate(int32_t sampleRate) {
+        mTicksPerBeat = ticksPerBeat(sampleRate);
+        mRampTicks = 0;
+        setPosition(0);
+    }
+
+    /**
+     * Change the tempo straight away, cancelling any ramp in progress
+     *
+     * @param tempo - playback speed, measured in beats per minute(bpm)
+     */
+    void setTempo(int tempo) {
+        mTicksPerFrame = tempo * kTempoResolution;
+        mRampTicks = 0;
+    }
+
+    /**
+     * Glide linearly from the current tempo to a new one over a number of beats
+     *
+     * @param tempo - playback speed at the end of the ramp, measured in beats per minute(bpm)
+     * @param beats - length of the ramp, the tempo changes straight away if not positive
+     */
+    void rampTempo(int tempo, int beats) {
+        if (beats <= 0) {
+            setTempo(tempo);
+            return;
+        }
+        mRampFrom = mTicksPerFrame;
+        mRampTo = tempo * kTempoResolution;
+        mRampTicks = std::min(beats, kMaxTempoRampBeats) * mTicksPerBeat;
+        mRampElapsed = 0;
+    }
+
+    bool isRamping() const { return mRampTicks > 0; }
+
+    int64_t getTicksPerBeat() const { return mTicksPerBeat; }
+
+    int64_t getTicksPerFrame() const { return mTicksPerFrame; }
+
+    int64_t getPosition() const { return mPosition.load(std::memory_order_relaxed); }
+
+    void setPosition(int64_t ticks) { mPosition.store(ticks, std::memory_order_relaxed); }
+
+    /**
+     * Move the clock forward, audio thread only
+     */
+    void advance(int32_t numFrames) {
+        int64_t ticks = numFrames * mTicksPerFrame;
+        setPosition(getPosition() + ticks);
+        if (isRamping()) {
+            updateRamp(ticks);
+        }
+    }
+
+    /**
+     * Number of frames to render before the frame nearest to a tick is reached, 0 if it is due
+     * on the current frame or already passed
+     */
+    int64_t framesUntil(int64_t tick) const {
+        int64_t distance = tick - getPosition() - mTicksPerFrame / 2;
+        if (distance <= 0) return 0;
+        return (distance + mTicksPerFrame - 1) / mTicksPerFrame;
+    }
+
+    /**
+     * @param stepsPerBeat - pattern steps in one beat, must divide getTicksPerBeat()
+     */
+    int64_t getTicksPerStep(int stepsPerBeat) const { return mTicksPerBeat / stepsPerBeat; }
+
+    /**
+     * @return index of the step nearest to a position, not wrapped to the loop length
+     */
+    int ticksToStep(int64_t ticks, int stepsPerBeat) const {
+        int64_t ticksPerStep = getTicksPerStep(stepsPerBeat);
+        return static_cast<int>((ticks + ticksPerStep / 2) / ticksPerStep);
+    }
+
+private:
+    void updateRamp(int64_t ticks) {
+        mRampElapsed += ticks;
+        if (mRampElapsed >= mRampTicks) {
+            mTicksPerFrame = mRampTo;
+            mRampTicks = 0;
+        } else {
+            mTicksPerFrame = mRampFrom + (mRampTo - mRampFrom) * mRampElapsed / mRampTicks;
+        }
+    }
+
+    int64_t mTicksPerBeat;
+    int64_t mTicksPerFrame = 60 * kTempoResolution;
+    int64_t mRampFrom = 0;
+    int64_t mRampTo = 0;
+    int64_t mRampTicks = 0; // 0 when not ramping
+    int64_t mRampElapsed = 0;
+    std::atomic<int64_t> mPosition { 0 };
+};
+
+#endif //DRUMMACHINE_BEATCLOCK_H
@@ -16,34 +16,127 @@
 
 #include <utils/logging.h>
 #include <thread>
-#include <cmath>
+#include <algorithm>
+#include <chrono>
 
 #include "DrumMachine.h"
 
-DrumMachine::DrumMachine(AAssetManager &assetManager): mAssetManager(assetManager) {
+DrumMachine::DrumMachine(std::unique_ptr<SampleProvider> sampleProvider,
+                         std::unique_ptr<AudioSink> audioSink)
+        : mSampleProvider(std::move(sampleProvider))
+        , mAudioSink(std::move(audioSink)) {
+}
+
+DrumMachine::~DrumMachine() {
+    waitForKit();
+}
+
+/**
+ * Give a track its own voices, e.g. one for a choked hihat or more for a long cymbal. Only before
+ * init or initAsync, the players are built with their voices when the kit loads.
+ *
+ * @param maxVoices - hits of the track's sample which can sound at the same time, 1 to kMaxVoices
+ * @param stealPolicy - voice a new hit cuts once all of them are sounding
+ * @return false, after logging, if the arguments are invalid or the kit is already loading
+ */
+bool DrumMachine::setTrackVoices(int trackIdx, int maxVoices, VoiceStealPolicy stealPolicy) {
+    if (trackIdx < 0 || trackIdx >= kTotalTrack || maxVoices < 1 || maxVoices > kMaxVoices) {
+        LOGW("Ignoring %d voices for track %d", maxVoices, trackIdx);
+        return false;
+    }
+    if (mIsKitLoaded || mKitLoaderThread.joinable()) {
+        LOGW("Ignoring voices for track %d, the kit is already loaded", trackIdx);
+        return false;
+    }
+    mTrackVoices[trackIdx] = {maxVoices, stealPolicy};
+    return true;
+}
+
+/**
+ * Initialise DrumMachine and load the kit, must always be called first (or initAsync)
+ *
+ * @return what was loaded and how long it took
+ */
+KitLoadReport DrumMachine::init(){
+    prepareInit();
+    return loadKit();
+}
+
+/**
+ * Like init(), but the kit is loaded on a background thread and this returns straight away, so
+ * the UI can show while the samples are decoded. Pattern edits are fine in the meantime, and
+ * starting playback waits for the kit.
+ *
+ * @param onKitLoaded - called on the loader thread once the kit is ready. It must not call back
+ *                      into the DrumMachine.
+ */
+void DrumMachine::initAsync(KitLoadedCallback onKitLoaded){
+    prepareInit();
+    mKitLoaderThread = std::thread([this, onKitLoaded]() {
+        KitLoadReport report = loadKit();
+        if (onKitLoaded) {
+            onKitLoaded(report);
+        }
+    });
 }
 
 /**
- * Initialise DrumMachine, must always be called first
+ * Everything runs at the sink's native rate: the samples are resampled to it as they are loaded,
+ * and the clock counts frames at it, so nothing converts rates while playing. The rate is settled
+ * before init returns, so that other threads never see it change.
  */
-void DrumMachine::init(){
+void DrumMachine::prepareInit(){
+    mSampleRate = mAudioSink->getNativeSampleRate();
+    mClock.setSampleRate(mSampleRate);
+    mCompiler.setSampleRate(mSampleRate);
+    LOGD("Sample rate %d Hz", mSampleRate);
+}
+
+/**
+ * Decode every sample of the kit in parallel, then hand them to the mixer in track order
+ */
+KitLoadReport DrumMachine::loadKit(){
     std::vector<std::string> asset_list = { "kick.wav","finger-cymbal.wav", "clap.wav", "splash.wav", "hihat.wav", "scratch.wav",
                                            "rim.wav", "snare.wav", "metronome.wav"};
-    for(std::string wav_file : asset_list){
-        // Load the RAW PCM data files for both the sample sound and backing track into memory.
-        std::shared_ptr<AAssetDataSource> mSampleSource(AAssetDataSource::newFromAssetManager(mAssetManager,
-                                                                                              wav_file.c_str(),
-                                                                                              oboe::ChannelCount::Stereo));
-        if (mSampleSource == nullptr){
-            LOGE("Could not load source data for kick sound");
-            return;
+    KitLoadReport report = KitLoader::load(*mSampleProvider, asset_list, kChannelCount, mSampleRate,
+                                           kMaxKitLoaderThreads);
+    for (const SampleLoadResult &sample : report.samples) {
+        if (sample.source == nullptr){
+            LOGE("Could not load source data for %s", sample.name.c_str());
+            break;
         }
-        std::shared_ptr<Player> mSamplePlayer = std::make_shared<Player>(mSampleSource);
+        const TrackVoiceConfig &voices = mTrackVoices[mPlayerList.size()];
+        std::shared_ptr<Player> mSamplePlayer = std::make_shared<Player>(
+                sample.source, voices.maxVoices, voices.stealPolicy);
         mPlayerList.push_back(mSamplePlayer);
         // Add the sample sounds to a mixer so that they can be played together
         // simultaneously using a single audio stream.
         mMixer.addTrack(mSamplePlayer);
     }
+    mIsKitLoaded = true;
+    return report;
+}
+
+/**
+ * Block until a kit load started by initAsync has finished
+ */
+void DrumMachine::waitForKit(){
+    if (mKitLoaderThread.joinable() && mKitLoaderThread.get_id() != std::this_thread::get_id()) {
+        mKitLoaderThread.join();
+    }
+}
+
+/**
+ * The beat clock divides by the tempo, so anything which sets it checks it first
+ *
+ * @return false, after logging, if the tempo is not positive
+ */
+static bool isValidTempo(int tempo) {
+    if (tempo <= 0) {
+        LOGW("Ignoring invalid tempo %d", tempo);
+        return false;
+    }
+    return true;
 }
 
 /**
@@ -53,64 +146,65 @@ void DrumMachine::init(){
  * @param beatIdx - position of the starting beat
  */
 void DrumMachine::start(int tempo, int beatIdx) {
+    mCompiler.setMetronomeOnly(false);
+    startPlayback(tempo, beatIdx);
+}
+
+/**
+ * Start the audio sink
+ *
+ * @param tempo - playback speed, measured in beats per minute(bpm)
+ * @param beatIdx - position of the starting beat
+ */
+void DrumMachine::startPlayback(int tempo, int beatIdx) {
     // Start the drum machine
     // Note: must call stop() first before calling start() for a second time
-
-    // Create a builder
-    AudioStreamBuilder builder;
-    builder.setFormat(AudioFormat::I16);
-    builder.setChannelCount(2);
-    builder.setSampleRate(kSampleRateHz);
-    builder.setCallback(this);
-    builder.setPerformanceMode(PerformanceMode::LowLatency);
-    builder.setSharingMode(SharingMode::Exclusive);
-
-    // Initialise tempo, starting beat etc.
-    setTempo(tempo);
-    setBeat(beatIdx);
-    mMetronomeOnly = false;
+    if (!isValidTempo(tempo)) return;
+    waitForKit();
+
+    // Initialise tempo, starting beat etc. The sink is stopped, so pending commands can be
+    // processed and the first schedule compiled and picked up directly from this thread. Commands
+    // posted from here on wait for the audio thread.
+    std::lock_guard<std::mutex> lock(mStoppedLock);
+    processCommands(false);
+    mClock.setTempo(tempo);
+    mCompiler.compile();
     refreshLoop();
+    setBeat(beatIdx);
 
-    Result result = builder.openStream(&mAudioStream);
-    if (result != Result::OK){
-        LOGE("Failed to open stream. Error: %s", convertToText(result));
-    }
-
-    // Reduce stream latency by setting the buffer size to a multiple of the burst size
-    auto setBufferSizeResult = mAudioStream->setBufferSizeInFrames(
-            mAudioStream->getFramesPerBurst() * kBufferSizeInBursts);
-    if (setBufferSizeResult != Result::OK){
-        LOGW("Failed to set buffer size. Error: %s", convertToText(setBufferSizeResult.error()));
-    }
-
-    // Start mixer
-    result = mAudioStream->requestStart();
-    if (result != Result::OK){
-        LOGE("Failed to start stream. Error: %s", convertToText(result));
+    mTelemetry.reset(mSampleRate);
+    if (!mAudioSink->start(this, mSampleRate, kChannelCount)) {
+        LOGE("Failed to start the audio sink");
     }
 }
 
 /**
- * Process beat events at the beginning of a loop
+ * Move on to the next queued pattern, if any, and pick up its latest compiled schedule at the
+ * beginning of a loop. Every pattern is compiled ahead of time, so switching is a pointer swap.
  */
 void DrumMachine::refreshLoop() {
-    // process all pending events and initialise a loop
-    mPlayerEvents = {};
-    processUpdateEvents();
-    preparePlayerEvents();
-    LOGD("after preparePlayerEvents()");
-    printBeatMap();
+    int32_t nextPattern;
+    if (mIsFollowingSong && mPatternQueue.pop(nextPattern)) {
+        if (mIsChainLooping) {
+            mPatternQueue.push(nextPattern);
+        }
+        mCurrentPattern = nextPattern;
+    }
+    mSchedule = mCompiler.acquireSchedule(mCurrentPattern);
+    mNextPlayerEvent = 0;
+    mPlayingGrid.store({mSchedule->numSteps, mSchedule->stepsPerBeat}, std::memory_order_relaxed);
 }
 
 /**
- * Stop playback close the audio stream
+ * Stop playback and the audio sink
  */
 void DrumMachine::stop(){
-
-    if (mAudioStream != nullptr){
-        mAudioStream->close();
-        delete mAudioStream;
-        mAudioStream = nullptr;
+    if (mAudioSink->isRunning()) {
+        mAudioSink->stop();
+        LOGD("Audio callback stats: %s", mTelemetry.getStats().toString().c_str());
+        // commands posted just before the stop are left over, nothing else will drain them
+        std::lock_guard<std::mutex> lock(mStoppedLock);
+        processCommands(false);
     }
 }
 
@@ -120,8 +214,8 @@ void DrumMachine::stop(){
  */
 void DrumMachine::startMetronome(int tempo) {
     // Play only the metronome track
-    mMetronomeOnly = true;
-    start(tempo, 0);
+    mCompiler.setMetronomeOnly(true);
+    startPlayback(tempo, 0);
 }
 
 /**
@@ -129,16 +223,19 @@ void DrumMachine::startMetronome(int tempo) {
  */
 void DrumMachine::stopMetronome() {
     // Stop the metronome playback
-    mMetronomeOnly = false;
+    mCompiler.setMetronomeOnly(false);
     stop();
 }
 
 /**
- * Update drum machine tempo
+ * Update drum machine tempo while playing, keeping the current position in the pattern
+ *
  * @param tempo - playback speed, measured in beats per minute(bpm)
+ * @param rampBeats - number of beats to glide to the new tempo over, 0 to change it immediately
  */
-void DrumMachine::setTempo(int tempo) {
-    mTempo = tempo;
+void DrumMachine::setTempo(int tempo, int rampBeats) {
+    if (!isValidTempo(tempo)) return;
+    postCommand({DrumMachineCommand::Type::SetTempo, 0, tempo, rampBeats, 0, 0});
 }
 
 /**
@@ -146,14 +243,15 @@ void DrumMachine::setTempo(int tempo) {
  * @param beatIdx
  */
 void DrumMachine::setBeat(int beatIdx){
-    if (beatIdx < 0 || beatIdx >= kTotalBeat) {
-        beatIdx = 0;
+    int64_t tick = quantizeBeatIdx(beatIdx);
+    mClock.setPosition(tick);
+    // skip the events before the starting beat, the next loop plays from the beginning again
+    mNextPlayerEvent = 0;
+    while (mNextPlayerEvent < mSchedule->numEvents &&
+           mSchedule->events[mNextPlayerEvent].tick < tick) {
+        mNextPlayerEvent++;
     }
-    // save beat index for calculation later
-    mBeatStartIndex = beatIdx;
-    int64_t frameNum = quantizeBeatIdx(beatIdx);
-    mCurrentFrame = frameNum;
-    // LOGD("setBeat: beat %d => mCurrentFrame %lld", beatIdx, frameNum);
+    // LOGD("setBeat: beat %d => tick %lld", beatIdx, tick);
 }
 
 /**
@@ -163,51 +261,28 @@ void DrumMachine::setBeat(int beatIdx){
  */
 void DrumMachine::resetTrack(int trackIdx) {
     LOGD("reset track:  %d", trackIdx);
-    for (int i = 0; i < kTotalBeat; i++) {
-        mBeatMap[trackIdx][i] = 0;
-    }
-
-    // clear pending update events for the track
-    std::tuple<int64_t, int> nextUpdateEvent;
-    std::queue<std::tuple<int64_t, int>> tmpUpdateEvents;
-
-    while (!mUpdateEvents.empty()) {
-        nextUpdateEvent = mUpdateEvents.front();
-        if (std::get<1>(nextUpdateEvent) != trackIdx){
-            tmpUpdateEvents.push(nextUpdateEvent);
-        }
-        mUpdateEvents.pop();
-        // LOGD("[processUpdateEvent] event(%lld,%d)-> beat_idx: %d", frameNum, trackIdx, beatIdx);
-    }
-    mUpdateEvents = tmpUpdateEvents;
-    printBeatMap();
+    mCompiler.resetTrack(trackIdx);
 }
 
 /**
  * Clear all beats on all tracks
  */
 void DrumMachine::resetAll() {
-    for (int i = 0; i < kTotalTrack; i++) {
-        for (int j = 0; j < kTotalBeat; j++) {
-            mBeatMap[i][j] = 0;
-        }
-    }
-
+    mCompiler.resetAll();
 }
 
 /**
- * Quantizes frame number & rounds beat to the right value if required
+ * Quantizes a playback position & rounds beat to the right value if required
  *
- * Quantization: after conversion, the beat index is rounded to the nearest integer [0, kTotalBeat)
+ * Quantization: after conversion, the step index is rounded to the nearest integer [0, numSteps)
+ * of the pattern which is playing, which may not be the one being edited
  *
- * @param frameNum - index of frame
- * @return index of beat
+ * @param tick - playback position in BeatClock ticks
+ * @return index of step
  */
-int DrumMachine::getBeatIdx(int64_t frameNum) {
-    /* Return the beat idx of a given frameNum, after quantization*/
-    float framePerBeat = round((60.0f / mTempo) * kSampleRateHz);
-    int beatIdx = static_cast<int>(round((float)frameNum / framePerBeat));
-    return beatIdx % kTotalBeat;
+int DrumMachine::getBeatIdx(int64_t tick) {
+    StepGrid grid = mPlayingGrid.load(std::memory_order_relaxed);
+    return mClock.ticksToStep(tick, grid.stepsPerBeat) % grid.numSteps;
 }
 
 /**
@@ -215,164 +290,408 @@ int DrumMachine::getBeatIdx(int64_t frameNum) {
  *
  * The function comprises of two steps:
  *  1) play the beat sample immediately
- *  2) enqueue the event to mUpdateEvents queue and update mBeatMap at
- *     the next round of the loop
+ *  2) add the beat to the pattern, which the compiler thread turns into a new schedule for the
+ *     next round of the loop
  *
  * @param track_idx - index of track
+ * @param velocity - loudness of the hit, e.g. from the intensity of the gesture
+ * @param pan - stereo position of the hit, kCenterPan by default
  * @return the index of beat to be inserted
  */
-int DrumMachine::insertBeat(int trackIdx) {
+int DrumMachine::insertBeat(int trackIdx, uint8_t velocity, uint8_t pan) {
     // TODO check audio stream state
-    mPlayerList[trackIdx]->setPlaying(true);
-    // update beat map at the end of the loop
-    int64_t currentFrame = mCurrentFrame;
-    mUpdateEvents.push(std::make_tuple(currentFrame, trackIdx));
-    return getBeatIdx(currentFrame);
+    playTrackSample(trackIdx, velocity, pan);
+    int beatIdx = getBeatIdx(mClock.getPosition());
+    mCompiler.setBeat(trackIdx, beatIdx, velocity, pan);
+    return beatIdx;
+}
+
+/**
+ * Add a beat to a given track at a given step, without playing it
+ *
+ * @param trackIdx - index of track
+ * @param beatIdx - index of step
+ * @param velocity - loudness of the hit
+ * @param pan - stereo position of the hit
+ */
+void DrumMachine::addBeat(int trackIdx, int beatIdx, uint8_t velocity, uint8_t pan) {
+    mCompiler.setBeat(trackIdx, beatIdx, velocity, pan);
 }
 
 /**
  * Play the sample assigned to a track
  */
-void DrumMachine::playTrackSample(int trackIdx){
-    mPlayerList[trackIdx]->setPlaying(true);
+void DrumMachine::playTrackSample(int trackIdx, uint8_t velocity, uint8_t pan){
+    postCommand({DrumMachineCommand::Type::PlayTrackSample, trackIdx, 0, 0, velocity, pan});
 }
 
 /**
- * Process events in mUpdteEvents queue and add beats to mBeatMap accordingly
+ * Start a hit on a track, audio thread only
  */
-void DrumMachine::processUpdateEvents() {
-    std::tuple<int64_t, int> nextUpdateEvent;
-    int framePerBeat =  static_cast<int>(round((60.0f / mTempo) * kSampleRateHz));
-    LOGD("[processUpdateEvent] using frames_per_beat: %d)", framePerBeat);
+void DrumMachine::triggerTrack(int trackIdx, uint8_t velocity, uint8_t pan) {
+    // the pattern may have more tracks than the kit has samples
+    if (trackIdx < 0 || trackIdx >= static_cast<int>(mPlayerList.size())) return;
+    mPlayerList[trackIdx]->trigger(velocity, pan);
+    // tracks are added to the mixer in the same order as mPlayerList
+    mMixer.activateTrack(static_cast<uint8_t>(trackIdx));
+}
 
+/**
+ * Queue a command for the audio thread. Never blocks, so it is safe to call from any thread.
+ *
+ * While the sink is stopped there is no audio thread to drain the queue, so the caller carries
+ * the command out itself, unless start() or an offline render owns the engine, which then does.
+ * A tap on a stopped sink can't be heard and is dropped rather than played on the next start.
+ */
+void DrumMachine::postCommand(const DrumMachineCommand &command) {
+    bool isStopped = !mAudioSink->isRunning();
+    if (isStopped && command.type == DrumMachineCommand::Type::PlayTrackSample) return;
+    if (!mCommands.push(command)) {
+        LOGW("Command queue full, dropping command %d", static_cast<int>(command.type));
+    }
+    if (!isStopped) return;
+    std::unique_lock<std::mutex> lock(mStoppedLock, std::try_to_lock);
+    if (lock.owns_lock() && !mAudioSink->isRunning()) {
+        processCommands(false);
+    }
+}
 
-    while (!mUpdateEvents.empty()) {
-        nextUpdateEvent = mUpdateEvents.front();
-        int64_t frameNum = std::get<0>(nextUpdateEvent);
-        int trackIdx = std::get<1>(nextUpdateEvent);
-        int beatIdx = getBeatIdx(frameNum);
-        mBeatMap[trackIdx][beatIdx] = 1;
-        mUpdateEvents.pop();
-        // LOGD("[processUpdateEvent] event(%lld,%d)-> beat_idx: %d", frameNum, trackIdx, beatIdx);
+/**
+ * Carry out all pending commands. Called by the audio thread at the start of every callback, or
+ * while the sink is stopped by the thread holding mStoppedLock.
+ *
+ * @param isAudioThread - false if the sink is stopped, its pending taps are then dropped
+ */
+void DrumMachine::processCommands(bool isAudioThread) {
+    DrumMachineCommand command;
+    while (mCommands.pop(command)) {
+        applyCommand(command, isAudioThread);
     }
 }
 
 /**
- * Convert the index of beat to the index of frame
+ * Carry out one command, see processCommands
+ */
+void DrumMachine::applyCommand(const DrumMachineCommand &command, bool isAudioThread) {
+    switch (command.type) {
+        case DrumMachineCommand::Type::PlayTrackSample:
+            if (isAudioThread) {
+                triggerTrack(command.trackIdx, command.velocity, command.pan);
+            }
+            break;
+        case DrumMachineCommand::Type::ToggleMetronome:
+            mMetronomeOn = !mMetronomeOn;
+            break;
+        case DrumMachineCommand::Type::SetTempo:
+            mClock.rampTempo(command.tempo, command.rampBeats);
+            break;
+        case DrumMachineCommand::Type::ClearPatternQueue: {
+            int32_t patternIdx;
+            while (mPatternQueue.pop(patternIdx)) {}
+            break;
+        }
+    }
+}
+
+/**
+ * Convert the index of step to a playback position in the schedule which is about to play. Only
+ * called while the audio sink is stopped.
  *
- * @param beatIdx - index of  beat
- * @return index of frame
+ * @param beatIdx - index of step
+ * @return position in BeatClock ticks
  */
 int64_t DrumMachine::quantizeBeatIdx(int beatIdx) {
-    /* Return the frame number of a given beat */
-    if (beatIdx < 0 || beatIdx >= kTotalBeat) {
+    if (beatIdx < 0 || beatIdx >= mSchedule->numSteps) {
         beatIdx = 0;
     }
-    float framePerBeat = round((60.0f / mTempo) * kSampleRateHz);
-    int64_t frameNum = static_cast<int64_t>(beatIdx * framePerBeat);
-    return frameNum;
+    return beatIdx * mSchedule->ticksPerStep;
 }
 
 /**
- * Read mBeatMap and insert beats to the playback queue
+ * Change the shape of the pattern, takes effect from the next round of the loop
+ *
+ * @param numSteps - length of the pattern, up to kMaxSteps
+ * @param stepsPerBeat - 1 for a step per beat, 2 for eighth notes, 3 for triplets etc.
+ * @param numTracks - tracks in the pattern, track i plays sample i of the kit, up to
+ *                    kMaxKitPatternTracks
+ * @return false if the geometry is not supported
  */
-void DrumMachine::preparePlayerEvents(){
-    // Add the audio frame numbers on which the sample sound should be played to the sample event queue.
-    // For example the tempo is 60 beats per minute, which is 1 beats per second. At a sample
-    // rate of 48000 frames per second this means a beat occurs every 48000 frames, starting at
-    // zero.
-    int frame_per_beat =  static_cast<int>(round((60.0f / mTempo) * kSampleRateHz));
-
-    for (int j=mBeatStartIndex; j < kTotalBeat; j++){
-        for (int i=0; i < kTotalTrack; i++){
-            if (mBeatMap[i][j] == 1 && !mMetronomeOnly) {
-                mPlayerEvents.push(std::make_tuple((int64_t) j * frame_per_beat, i));
-                // DEBUG
-                // LOGD("Add PlayerEvent: ch%d, beat%d, frame %ld", j, i, (int64_t) j * frame_per_beat);
-            }
-        }
-        // always add metronome events
-        mPlayerEvents.push(std::make_tuple((int64_t) j * frame_per_beat, kMetronomeTrackIdx));
-        // DEBUG
-        // LOGD("Add PlayerEvent: ch-metro, beat%d, frame %ld", j, (int64_t) j * frame_per_beat);
+bool DrumMachine::setPatternGeometry(int numSteps, int stepsPerBeat, int numTracks) {
+    if (numTracks > kMaxKitPatternTracks) {
+        LOGW("Ignoring pattern with %d tracks, the kit has %d samples besides the metronome",
+             numTracks, kMaxKitPatternTracks);
+        return false;
     }
-    // reset starting beat in the next round so we can start from the beginning again
-    if (mBeatStartIndex != 0){
-        mBeatStartIndex = 0;
+    PatternGeometry geometry;
+    geometry.numSteps = numSteps;
+    geometry.stepsPerBeat = stepsPerBeat;
+    geometry.numTracks = numTracks;
+    return mCompiler.setGeometry(geometry);
+}
+
+/**
+ * Change the timing feel of the pattern, takes effect from the next round of the loop
+ *
+ * @param swing - position of every second step within its pair in percent, 50 for straight time
+ * @param microTiming - offset of each step in 1/kMicroTimingResolution of a step, may be null
+ * @param numSteps - number of entries in microTiming, the remaining steps stay on the grid
+ * @return false if the groove is out of range
+ */
+bool DrumMachine::setGroove(int swing, const int16_t *microTiming, int numSteps) {
+    Groove groove;
+    groove.swing = swing;
+    for (int j = 0; microTiming != nullptr && j < std::min(numSteps, kMaxSteps); j++) {
+        groove.microTiming[j] = microTiming[j];
     }
+    return mCompiler.setGroove(groove);
 }
 
 /**
- * Print out beat arragements in all channels
+ * Choose the pattern edited by setBeat, insertBeat, resetTrack etc. It keeps playing its part of
+ * the song, edits are heard the next time it comes round.
+ *
+ * @return false if there is no such pattern
  */
-void DrumMachine::printBeatMap(){
-    LOGD("[mBeatMap]");
-    for (int i=0; i < (kTotalTrack - 1); i++){
-        std::string output = "ch" + std::to_string(i);
-        for (int j=0; j < kTotalBeat; j++){
-            if (mBeatMap[i][j] == 0){
-                output += "[ ]";
-            } else {
-                output += "[x]";
-            }
-        }
-        LOGD("%s", output.c_str());
+bool DrumMachine::selectPattern(int patternIdx) {
+    return mCompiler.setEditPattern(patternIdx);
+}
+
+/**
+ * Append a pattern to the song. Each loop plays the next queued pattern, and the last one keeps
+ * repeating once the queue runs out. Never blocks the audio thread.
+ *
+ * @return false if there is no such pattern or the queue is full
+ */
+bool DrumMachine::queuePattern(int patternIdx) {
+    if (patternIdx < 0 || patternIdx >= kMaxPatterns) {
+        LOGW("No pattern %d", patternIdx);
+        return false;
     }
+    if (!mPatternQueue.push(patternIdx)) {
+        LOGW("Pattern queue full, dropping pattern %d", patternIdx);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Drop all queued patterns, the current one keeps playing
+ */
+void DrumMachine::clearPatternQueue() {
+    postCommand({DrumMachineCommand::Type::ClearPatternQueue, 0, 0, 0, 0, 0});
+}
+
+/**
+ * Loop the queued patterns as a chain, e.g. A-A-B-fill, instead of stopping on the last one
+ */
+void DrumMachine::setChainLooping(bool isLooping) {
+    mIsChainLooping = isLooping;
 }
 
 /**
  * Turn on/off metronome-only playback mode
  */
 void DrumMachine::toggleMetronome() {
-    mMetronomeOn = !mMetronomeOn;
+    postCommand({DrumMachineCommand::Type::ToggleMetronome, 0, 0, 0, 0, 0});
 }
 
 /**
  * A callback function for the audio driver to fetch the next numFrames of audio to be played
  *
- * @param oboeStream
+ * The callback is split only at the frames where a player event is due or the loop wraps, and
+ * the spans in between are rendered by the mixer as whole blocks. Event and loop positions are
+ * converted to frames by mClock, so the sub-frame remainder carries over from beat to beat, and a
+ * tempo change only alters how far ahead the next event is. During a tempo ramp the spans are
+ * kept short so that the tempo can follow the ramp. Every callback is timed into mTelemetry.
+ *
  * @param audioData
+ * @param isFloat
  * @param numFrames
- * @return keep the audio stream open
- */
-DataCallbackResult DrumMachine::onAudioReady(AudioStream *oboeStream, void *audioData, int32_t numFrames) {
-    std::tuple<int64_t, int> nextClapEvent;
-    int32_t loop_duration = kTotalBeat * static_cast<int>(round((60.0f / mTempo) * kSampleRateHz));
-
-    for (int i = 0; i < numFrames; ++i) {
-
-        // DEBUG
-//        int64_t tmpFrame = mCurrentFrame;
-//        std::tuple<int64_t, int> tmpClapEvent;
-//        if (tmpFrame % kSampleRateHz == 0) {
-//            tmpClapEvent = mPlayerEvents.front();
-//            int64_t nextFrame = std::get<0>(tmpClapEvent);
-//            int nextTrack = std::get<1>(tmpClapEvent);
-//            LOGD("ON_BEAT %ld, nextClapEvent(%d, %ld)", tmpFrame, nextTrack, nextFrame);
-//        }
-
-        // play sample sounds
-        while (!mPlayerEvents.empty() && mCurrentFrame == std::get<0>(mPlayerEvents.front())) {
-            nextClapEvent = mPlayerEvents.front();
-            int trackIdx = std::get<1>(nextClapEvent);
-
-            if ((trackIdx != kMetronomeTrackIdx) || (trackIdx == kMetronomeTrackIdx && mMetronomeOn)) {
-                // DEBUG
-                // LOGD("onAudioReady - Play ch%d at %ld", trackIdx, tmpFrame);
-                mPlayerList[std::get<1>(nextClapEvent)]->setPlaying(true);
-                mPlayerEvents.pop();
-            }
+ */
+void DrumMachine::onRenderAudio(void *audioData, bool isFloat, int32_t numFrames) {
+    auto startTime = std::chrono::steady_clock::now();
+    processCommands(true);
+    renderFrames(audioData, isFloat, numFrames);
+    auto duration = std::chrono::steady_clock::now() - startTime;
+    mTelemetry.record(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(),
+                      numFrames, mAudioSink->getXRunCount());
+}
+
+/**
+ * Trigger the events of the schedule which are due on the current frame, audio thread only
+ */
+void DrumMachine::triggerDueEvents() {
+    while (mNextPlayerEvent < mSchedule->numEvents &&
+           mClock.framesUntil(mSchedule->events[mNextPlayerEvent].tick) == 0) {
+        const PlayerEvent &event = mSchedule->events[mNextPlayerEvent];
+        if (!event.isMetronome || mMetronomeOn) {
+            triggerTrack(event.trackIdx, event.velocity, event.pan);
         }
+        mNextPlayerEvent++;
+    }
+}
+
+/**
+ * Play the schedule from the current position and mix numFrames of audio. Shared by the audio
+ * callback and the offline render.
+ *
+ * @param audioData - interleaved stereo output, float or int16_t
+ * @param isFloatOutput
+ * @param numFrames
+ */
+void DrumMachine::renderFrames(void *audioData, bool isFloatOutput, int32_t numFrames) {
+    int32_t framesRendered = 0;
+
+    while (framesRendered < numFrames) {
 
-        mMixer.renderAudio(static_cast<int16_t*>(audioData)+(kChannelCount*i), 1);
-        mCurrentFrame++;
+        // play sample sounds which are due on the current frame. This comes before the wrap, as
+        // events within half a frame of the end of the loop are due on the frame where it wraps.
+        triggerDueEvents();
 
-        if ( mCurrentFrame > loop_duration ) {
-            mCurrentFrame = 0;
+        // the loop wraps on the frame nearest to its end, keeping the remainder so that the next
+        // loop starts exactly where this one ended
+        if (mClock.framesUntil(mSchedule->loopTicks) == 0) {
+            mClock.setPosition(mClock.getPosition() - mSchedule->loopTicks);
             refreshLoop();
+            triggerDueEvents();
+        }
+
+        // render up to the next event, the end of the loop or the end of the callback, whichever
+        // comes first
+        int64_t segmentFrames = mClock.framesUntil(mSchedule->loopTicks);
+        if (mNextPlayerEvent < mSchedule->numEvents) {
+            segmentFrames = std::min(segmentFrames,
+                                     mClock.framesUntil(mSchedule->events[mNextPlayerEvent].tick));
+        }
+        if (mClock.isRamping()) {
+            segmentFrames = std::min<int64_t>(segmentFrames, kTempoRampUpdateFrames);
+        }
+        auto framesToRender = static_cast<int32_t>(std::min<int64_t>(
+                {segmentFrames, numFrames - framesRendered, kMaxFramesPerRender}));
+
+        if (isFloatOutput) {
+            mMixer.renderAudio(static_cast<float*>(audioData) + (kChannelCount * framesRendered),
+                               framesToRender);
+        } else {
+            mMixer.renderAudio(static_cast<int16_t*>(audioData) + (kChannelCount * framesRendered),
+                               framesToRender);
+        }
+        framesRendered += framesToRender;
+        mClock.advance(framesToRender);
+    }
+}
+
+/**
+ * Render numLoops loops of the current pattern as fast as possible, through the same code as the
+ * audio callback. Pending live hits are dropped, sounding samples are cut, the metronome is left
+ * out and the song queue is not advanced, so the same pattern always renders the same output.
+ *
+ * @param tempo - playback speed, measured in beats per minute(bpm)
+ * @param numLoops - number of times to play the pattern
+ * @param consumer - called with each block of interleaved stereo int16_t audio and its frame count
+ * @param result - filled in with the length and speed of the render, may be null
+ * @return false if the audio sink is running or the tempo or number of loops is invalid
+ */
+bool DrumMachine::renderOffline(int tempo, int numLoops,
+                                const std::function<void(const int16_t *, int32_t)> &consumer,
+                                OfflineRenderResult *result) {
+    std::lock_guard<std::mutex> lock(mStoppedLock);
+    if (mAudioSink->isRunning()) {
+        LOGE("Offline render needs the audio sink to be stopped");
+        return false;
+    }
+    if (!isValidTempo(tempo)) return false;
+    if (numLoops <= 0) {
+        LOGE("Invalid offline render, %d loops", numLoops);
+        return false;
+    }
+    waitForKit();
+    auto startTime = std::chrono::steady_clock::now();
+
+    // start from silence at the top of the pattern, with every streamed tail resident
+    processCommands(false);
+    for (auto &player : mPlayerList) {
+        player->setPlaying(false);
+        player->setSourcePinned(true);
+    }
+    bool wasMetronomeOn = mMetronomeOn;
+    mMetronomeOn = false;
+    mIsFollowingSong = false;
+    mClock.setTempo(tempo);
+    mCompiler.compile();
+    refreshLoop();
+    setBeat(0);
+
+    // the loop wraps on the frame nearest to its end, so this is exactly numLoops loops long
+    const int64_t ticksPerFrame = mClock.getTicksPerFrame();
+    const int64_t totalFrames = (numLoops * mSchedule->loopTicks + ticksPerFrame / 2) / ticksPerFrame;
+
+    // Commands posted during the render are kept out of it, and carried out once it is over. They
+    // are taken off the queue as it goes, so that a long render can't fill it.
+    std::vector<DrumMachineCommand> postedCommands;
+    DrumMachineCommand command;
+    constexpr int32_t kOfflineBlockFrames = 1024;
+    int16_t block[kOfflineBlockFrames * kChannelCount];
+    for (int64_t frame = 0; frame < totalFrames; frame += kOfflineBlockFrames) {
+        auto numFrames = static_cast<int32_t>(std::min<int64_t>(kOfflineBlockFrames, totalFrames - frame));
+        renderFrames(block, false, numFrames);
+        consumer(block, numFrames);
+        while (mCommands.pop(command)) {
+            postedCommands.push_back(command);
         }
+    }
 
+    for (auto &player : mPlayerList) {
+        player->setSourcePinned(false);
+    }
+    mMetronomeOn = wasMetronomeOn;
+    mIsFollowingSong = true;
+    for (const DrumMachineCommand &postedCommand : postedCommands) {
+        applyCommand(postedCommand, false);
+    }
+    processCommands(false);
+
+    double renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    double audioSeconds = static_cast<double>(totalFrames) / mSampleRate;
+    LOGD("Rendered %.1f s of audio in %.3f s, %.1fx real time", audioSeconds, renderSeconds,
+         audioSeconds / renderSeconds);
+    if (result != nullptr) {
+        result->numFrames = totalFrames;
+        result->renderSeconds = renderSeconds;
+        result->realtimeMultiple = renderSeconds > 0 ? audioSeconds / renderSeconds : 0;
     }
-    return DataCallbackResult::Continue;
+    return true;
 }
 
+/**
+ * Render numLoops loops of the current pattern into memory, see renderOffline
+ *
+ * @param buffer - replaced with the interleaved stereo int16_t audio
+ */
+bool DrumMachine::renderToBuffer(int tempo, int numLoops, std::vector<int16_t> &buffer,
+                                 OfflineRenderResult *result) {
+    buffer.clear();
+    return renderOffline(tempo, numLoops, [&buffer](const int16_t *data, int32_t numFrames) {
+        buffer.insert(buffer.end(), data, data + numFrames * kChannelCount);
+    }, result);
+}
+
+/**
+ * Render numLoops loops of the current pattern to a 16 bit stereo WAV file, see renderOffline
+ *
+ * @param path - file to create or overwrite
+ */
+bool DrumMachine::exportWav(const char *path, int tempo, int numLoops, OfflineRenderResult *result) {
+    WavWriter writer;
+    if (!writer.open(path, mSampleRate, kChannelCount)) {
+        return false;
+    }
+    bool isRendered = renderOffline(tempo, numLoops, [&writer](const int16_t *data, int32_t numFrames) {
+        writer.write(data, numFrames);
+    }, result);
+    if (!writer.close()) {
+        LOGE("Failed to write %s", path);
+        return false;
+    }
+    return isRendered;
+}
@@ -17,64 +17,163 @@
 #ifndef DRUMMACHINE_H
 #define DRUMMACHINE_H
 
-#include <android/asset_manager.h>
-#include <oboe/Oboe.h>
-#include <tuple>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
-#include <queue>
 #include <string>
 
 #include "audio/Mixer.h"
 #include "audio/Player.h"
-#include "audio/AAssetDataSource.h"
+#include "audio/AudioSink.h"
+#include "audio/CallbackTelemetry.h"
+#include "audio/SampleProvider.h"
+#include "audio/WavWriter.h"
 #include "utils/LockFreeQueue.h"
+#include "utils/LockFreeMpscQueue.h"
 #include "DrumMachineConstants.h"
+#include "BeatClock.h"
+#include "KitLoader.h"
+#include "PatternCompiler.h"
 
-using namespace oboe;
+/**
+ * Outcome of an offline render
+ */
+struct OfflineRenderResult {
+    int64_t numFrames = 0;
+    double renderSeconds = 0;
+    double realtimeMultiple = 0; // seconds of audio rendered per second of wall clock time
+};
+
+/**
+ * How many hits of a track's sample can sound at the same time, and which one a new hit cuts
+ */
+struct TrackVoiceConfig {
+    int32_t maxVoices = kDefaultMaxVoices;
+    VoiceStealPolicy stealPolicy = VoiceStealPolicy::Oldest;
+};
+
+/**
+ * A control request posted from a JNI thread and carried out on the audio thread
+ */
+struct DrumMachineCommand {
+    enum class Type : int32_t {
+        PlayTrackSample,
+        ToggleMetronome,
+        SetTempo,
+        ClearPatternQueue,
+    };
 
-class DrumMachine : public AudioStreamCallback {
+    Type type;
+    int32_t trackIdx;
+    int32_t tempo;
+    int32_t rampBeats;
+    uint8_t velocity;
+    uint8_t pan;
+};
+
+/**
+ * The drum machine engine. It loads its kit through a SampleProvider and plays through an
+ * AudioSink, so the same engine runs on a device (assets, Oboe) and on the host (files, null or WAV
+ * sink).
+ */
+class DrumMachine : public AudioSinkCallback {
 public:
-    explicit DrumMachine(AAssetManager&);
-    void init();
+    using KitLoadedCallback = std::function<void(const KitLoadReport &)>;
+
+    DrumMachine(std::unique_ptr<SampleProvider> sampleProvider, std::unique_ptr<AudioSink> audioSink);
+    ~DrumMachine();
+    bool setTrackVoices(int trackIdx, int maxVoices, VoiceStealPolicy stealPolicy);
+    KitLoadReport init();
+    void initAsync(KitLoadedCallback onKitLoaded);
+    bool isKitLoaded() const { return mIsKitLoaded; }
     void start(int tempo, int beatIdx);
     void stop();
     void startMetronome(int tempo);
     void stopMetronome();
-    void setTempo(int tempo);
+    void setTempo(int tempo, int rampBeats = 0);
     void setBeat(int beat_idx);
     void resetTrack(int track_idx);
     void resetAll();
-    int insertBeat(int track_idx);
+    int insertBeat(int track_idx, uint8_t velocity = kMaxVelocity, uint8_t pan = kCenterPan);
+    void addBeat(int trackIdx, int beatIdx, uint8_t velocity = kMaxVelocity, uint8_t pan = kCenterPan);
     void toggleMetronome();
-    void playTrackSample(int trackIdx);
+    bool setPatternGeometry(int numSteps, int stepsPerBeat, int numTracks);
+    bool setGroove(int swing, const int16_t *microTiming, int numSteps);
+    void playTrackSample(int trackIdx, uint8_t velocity = kMaxVelocity, uint8_t pan = kCenterPan);
+    bool selectPattern(int patternIdx);
+    bool queuePattern(int patternIdx);
+    void clearPatternQueue();
+    void setChainLooping(bool isLooping);
+    int getCurrentPattern() const { return mCurrentPattern; }
+    int32_t getSampleRate() const { return mSampleRate; }
+    CallbackStats getCallbackStats() const { return mTelemetry.getStats(); }
+
+    // Offline rendering, only while the audio sink is stopped
+    bool renderOffline(int tempo, int numLoops,
+                       const std::function<void(const int16_t *, int32_t)> &consumer,
+                       OfflineRenderResult *result = nullptr);
+    bool renderToBuffer(int tempo, int numLoops, std::vector<int16_t> &buffer,
+                        OfflineRenderResult *result = nullptr);
+    bool exportWav(const char *path, int tempo, int numLoops, OfflineRenderResult *result = nullptr);
     // void onSurfaceChanged(int widthInPixels, int heightInPixels);
 
-    // Inherited from oboe::AudioStreamCallback
-    DataCallbackResult
-    onAudioReady(AudioStream *oboeStream, void *audioData, int32_t numFrames) override;
+    // Inherited from AudioSinkCallback
+    void onRenderAudio(void *audioData, bool isFloat, int32_t numFrames) override;
 
 private:
-    void preparePlayerEvents();
-    void processUpdateEvents();
-    int getBeatIdx(int64_t frameNum);
+    friend class DrumMachineBenchmark; // times refreshLoop
+
+    void prepareInit();
+    KitLoadReport loadKit();
+    void waitForKit();
+    void startPlayback(int tempo, int beatIdx);
+    void postCommand(const DrumMachineCommand &command);
+    void processCommands(bool isAudioThread);
+    void applyCommand(const DrumMachineCommand &command, bool isAudioThread);
+    void triggerTrack(int trackIdx, uint8_t velocity, uint8_t pan);
+    void triggerDueEvents();
+    int getBeatIdx(int64_t tick);
     int64_t quantizeBeatIdx(int beat_idx);
-    void printBeatMap();
     void refreshLoop();
+    void renderFrames(void *audioData, bool isFloatOutput, int32_t numFrames);
 
 
-    AAssetManager& mAssetManager;
-    AudioStream *mAudioStream{nullptr};
+    std::unique_ptr<SampleProvider> mSampleProvider;
+    std::unique_ptr<AudioSink> mAudioSink;
+    int32_t mSampleRate = kDefaultSampleRateHz; // the sink's native rate, set by init()
+    std::thread mKitLoaderThread; // running initAsync
+    std::atomic<bool> mIsKitLoaded { false };
+    std::array<TrackVoiceConfig, kTotalTrack> mTrackVoices; // applied by loadKit
     std::vector<std::shared_ptr<Player>> mPlayerList;
     Mixer mMixer;
 
-    std::queue<std::tuple<int64_t, int>> mPlayerEvents;
-    std::queue<std::tuple<int64_t, int>> mUpdateEvents;
-    std::atomic<int64_t> mCurrentFrame { 0 };
-    int mBeatMap[kTotalTrack][kTotalBeat] = {{ 0 }};
-    int mTempo = 60;
-    int mBeatStartIndex = 0;
+    // The pattern is edited and compiled off the audio thread
+    PatternCompiler mCompiler;
+
+    // Control calls only post commands, everything below is changed on the audio thread (or
+    // while the stream is closed, by the thread holding mStoppedLock)
+    LockFreeMpscQueue<DrumMachineCommand, kMaxQueueItems> mCommands;
+    std::mutex mStoppedLock; // never taken by the audio thread
+    // Song mode: patterns to play next, one per loop. A looping chain is requeued as it plays.
+    LockFreeMpscQueue<int32_t, kMaxQueuedPatterns> mPatternQueue;
+    std::atomic<bool> mIsChainLooping { false };
+    std::atomic<int> mCurrentPattern { 0 };
+    bool mIsFollowingSong = true; // false to keep looping mCurrentPattern
+    const PatternSchedule *mSchedule = nullptr;
+    int mNextPlayerEvent = 0;
+    // The step grid of mSchedule, for JNI threads which quantise a live hit to what is playing
+    struct StepGrid {
+        int32_t numSteps;
+        int32_t stepsPerBeat;
+    };
+    std::atomic<StepGrid> mPlayingGrid { StepGrid{kDefaultNumSteps, kDefaultStepsPerBeat} };
+    BeatClock mClock; // playback position, also read by JNI threads
     bool mMetronomeOn = true;
-    bool mMetronomeOnly = false;
+    CallbackTelemetry mTelemetry; // timing of every callback since the sink was started
 };
 
 
@@ -17,11 +17,27 @@
 #ifndef DRUMMACHINE_CONSTANTS_H
 #define DRUMMACHINE_CONSTANTS_H
 
-constexpr int kSampleRateHz = 48000; // Fixed sample rate, see README
+constexpr int kDefaultSampleRateHz = 48000; // Used if the device's native rate is unknown
 constexpr int kBufferSizeInBursts = 2; // Use 2 bursts as the buffer size (double buffer)
 constexpr int kMaxQueueItems = 64; // Must be power of 2
-constexpr int kTotalBeat = 16;
-constexpr int kTotalTrack = 9;
-constexpr int kMetronomeTrackIdx = 8; // last track reserved for metronome
+constexpr int kTotalTrack = 9; // samples in the kit
+constexpr int kMetronomeTrackIdx = 8; // last sample of the kit, the metronome click
+constexpr int kMaxKitLoaderThreads = 4; // samples decoded at the same time by init()
+
+// Pattern geometry, see PatternGeometry
+constexpr int kDefaultNumSteps = 16;
+constexpr int kDefaultStepsPerBeat = 1;
+constexpr int kDefaultNumPatternTracks = 8; // the kit without the metronome
+constexpr int kMaxKitPatternTracks = kTotalTrack - 1; // a track needs a sample, the metronome has none
+constexpr int kMaxSteps = 64;
+constexpr int kMaxStepsPerBeat = 16;
+constexpr int kMaxPatternTracks = 64;
+constexpr int kMaxPatterns = 8; // patterns which can be chained in song mode
+constexpr int kMaxQueuedPatterns = 64; // Must be power of 2
+constexpr int kStraightSwing = 50; // percent, see Groove
+constexpr int kMaxSwing = 75;
+constexpr int kMicroTimingResolution = 1000; // micro-timing is measured in 1/1000 of a step
+constexpr int kMaxMicroTiming = kMicroTimingResolution / 2;
+constexpr int kMaxPlayerEvents = kMaxSteps * (kMaxPatternTracks + 1); // every track plus the metronome on every step
 
 #endif //DRUM_MACHINE_CONSTANTS_H
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <utils/logging.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "KitLoader.h"
+
+/**
+ * @return whether every sample loaded
+ */
+bool KitLoadReport::isComplete() const {
+    return std::all_of(samples.begin(), samples.end(),
+                       [](const SampleLoadResult &sample) { return sample.source != nullptr; });
+}
+
+KitLoadReport KitLoader::load(SampleProvider &provider, const std::vector<std::string> &names,
+                              int32_t channelCount, int32_t sampleRate, int maxThreads) {
+    auto startTime = std::chrono::steady_clock::now();
+    KitLoadReport report;
+    report.samples.resize(names.size());
+
+    // each worker claims the next sample until there are none left, so a slow sample doesn't hold
+    // up the ones queued behind it
+    std::atomic<size_t> nextSample { 0 };
+    auto worker = [&]() {
+        for (size_t i = nextSample++; i < names.size(); i = nextSample++) {
+            auto sampleStart = std::chrono::steady_clock::now();
+            SampleLoadResult &result = report.samples[i];
+            result.name = names[i];
+            result.source = provider.loadSample(names[i], channelCount, sampleRate);
+            result.loadMillis = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - sampleStart).count();
+        }
+    };
+
+    auto numCores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    report.numThreads = std::max(1, std::min({maxThreads, numCores, static_cast<int>(names.size())}));
+
+    // the calling thread is one of the workers
+    std::vector<std::thread> threads;
+    for (int t = 1; t < report.numThreads; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    report.totalMillis = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - startTime).count();
+    for (const SampleLoadResult &sample : report.samples) {
+        if (sample.source == nullptr) {
+            LOGD("Loaded %s in %.1f ms (failed)", sample.name.c_str(), sample.loadMillis);
+            continue;
+        }
+        size_t decodedBytes = static_cast<size_t>(sample.source->getTotalFrames()) *
+                              sample.source->getChannelCount() * sizeof(int16_t);
+        size_t residentBytes = sample.source->getResidentBytes();
+        double tailFillMillis = sample.source->getTailFillMillis();
+        report.decodedBytes += decodedBytes;
+        report.residentBytes += residentBytes;
+        report.tailFillMillis += tailFillMillis;
+        LOGD("Loaded %s in %.1f ms, %zu of %zu KB resident, tail fills in %.1f ms",
+             sample.name.c_str(), sample.loadMillis, residentBytes / 1024, decodedBytes / 1024,
+             tailFillMillis);
+    }
+    LOGD("Loaded %zu samples in %.1f ms on %d threads, %zu of %zu KB resident (%zu KB saved), "
+         "tails fill in %.1f ms", names.size(), report.totalMillis, report.numThreads,
+         report.residentBytes / 1024, report.decodedBytes / 1024,
+         (report.decodedBytes - report.residentBytes) / 1024, report.tailFillMillis);
+    return report;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DRUMMACHINE_KITLOADER_H
+#define DRUMMACHINE_KITLOADER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "audio/DataSource.h"
+#include "audio/SampleProvider.h"
+
+/**
+ * One sample of the kit, nullptr source if it failed to load
+ */
+struct SampleLoadResult {
+    std::string name;
+    std::shared_ptr<DataSource> source;
+    double loadMillis = 0;
+};
+
+/**
+ * Outcome of loading a kit, in the order the samples were asked for
+ */
+struct KitLoadReport {
+    std::vector<SampleLoadResult> samples;
+    double totalMillis = 0;
+    int numThreads = 0;
+    size_t decodedBytes = 0; // the whole kit as 16 bit PCM
+    size_t residentBytes = 0; // what the kit holds on to while silent, less if samples are streamed
+    // prefetch thread time to fill in every streamed tail once, measured while loading. This is
+    // what streaming costs while the samples play, e.g. ADPCM decoding.
+    double tailFillMillis = 0;
+
+    bool isComplete() const;
+};
+
+/**
+ * Loads the samples of a kit concurrently. Decoding and resampling are CPU bound and independent
+ * for each sample, so a few worker threads each take the next sample as soon as they are free.
+ */
+class KitLoader {
+public:
+    /**
+     * Load every sample, blocking until all are done
+     *
+     * @param provider - must allow concurrent loadSample calls
+     * @param maxThreads - upper bound on the worker threads, also limited by the number of cores
+     */
+    static KitLoadReport load(SampleProvider &provider, const std::vector<std::string> &names,
+                              int32_t channelCount, int32_t sampleRate, int maxThreads);
+};
+
+#endif //DRUMMACHINE_KITLOADER_H
@@ -0,0 +1,380 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/logging.h>
+#include <algorithm>
+#include <string>
+
+#include "PatternCompiler.h"
+
+PatternCompiler::PatternCompiler() {
+    // one schedule to build into, the others are handed out by compile()
+    mSpare = &mSchedules[0];
+    for (int i = 1; i < kNumSchedules; i++) {
+        mRetired.push(&mSchedules[i]);
+    }
+    for (int p = 0; p < kMaxPatterns; p++) {
+        mPublished[p] = nullptr;
+        mPlaying[p] = nullptr;
+    }
+    // every pattern needs a schedule before it can be played
+    mDirtyPatterns = (1u << kMaxPatterns) - 1;
+    mThread = std::thread(&PatternCompiler::run, this);
+}
+
+PatternCompiler::~PatternCompiler() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mIsRunning = false;
+    }
+    mCondition.notify_one();
+    mThread.join();
+}
+
+/**
+ * @return whether the pattern fits the preallocated schedules and every step lands on a whole tick
+ */
+bool PatternGeometry::isValid(int64_t ticksPerBeat) const {
+    return numSteps > 0 && numSteps <= kMaxSteps &&
+           numTracks > 0 && numTracks <= kMaxPatternTracks &&
+           stepsPerBeat > 0 && stepsPerBeat <= kMaxStepsPerBeat &&
+           ticksPerBeat % stepsPerBeat == 0;
+}
+
+/**
+ * @return whether the swing and every step's micro-timing are within range
+ */
+bool Groove::isValid() const {
+    if (swing < kStraightSwing || swing > kMaxSwing) return false;
+    for (int16_t offset : microTiming) {
+        if (offset < -kMaxMicroTiming || offset > kMaxMicroTiming) return false;
+    }
+    return true;
+}
+
+/**
+ * Choose the pattern which the following edits apply to
+ *
+ * @return false if there is no such pattern
+ */
+bool PatternCompiler::setEditPattern(int patternIdx) {
+    if (patternIdx < 0 || patternIdx >= kMaxPatterns) {
+        LOGW("No pattern %d", patternIdx);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mLock);
+    mEditPatternIdx = patternIdx;
+    return true;
+}
+
+/**
+ * Add a beat to the pattern
+ *
+ * @param trackIdx - index of track
+ * @param beatIdx - index of step
+ * @param velocity - loudness of the hit, 0 to kMaxVelocity
+ * @param pan - stereo position of the hit, kCenterPan for the middle
+ */
+void PatternCompiler::setBeat(int trackIdx, int beatIdx, uint8_t velocity, uint8_t pan) {
+    std::lock_guard<std::mutex> lock(mLock);
+    Pattern &pattern = editPattern();
+    if (trackIdx < 0 || trackIdx >= pattern.geometry.numTracks ||
+        beatIdx < 0 || beatIdx >= pattern.geometry.numSteps) {
+        LOGW("Ignoring beat outside the pattern, track %d step %d", trackIdx, beatIdx);
+        return;
+    }
+    pattern.beatMap[beatIdx] |= uint64_t(1) << trackIdx;
+    pattern.velocity[beatIdx][trackIdx] = velocity;
+    pattern.pan[beatIdx][trackIdx] = pan;
+    markDirty(1u << mEditPatternIdx);
+}
+
+/**
+ * Clear all beats on a given track
+ */
+void PatternCompiler::resetTrack(int trackIdx) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (trackIdx < 0 || trackIdx >= kMaxPatternTracks) return;
+    Pattern &pattern = editPattern();
+    for (int j = 0; j < kMaxSteps; j++) {
+        pattern.beatMap[j] &= ~(uint64_t(1) << trackIdx);
+    }
+    markDirty(1u << mEditPatternIdx);
+}
+
+/**
+ * Clear all beats on all tracks
+ */
+void PatternCompiler::resetAll() {
+    std::lock_guard<std::mutex> lock(mLock);
+    Pattern &pattern = editPattern();
+    for (int j = 0; j < kMaxSteps; j++) {
+        pattern.beatMap[j] = 0;
+    }
+    markDirty(1u << mEditPatternIdx);
+}
+
+/**
+ * Change the shape of the pattern, takes effect from the next round of the loop. Beats outside
+ * the new shape are kept, and play again if the pattern grows back.
+ *
+ * @return false if the geometry is not supported, the pattern is then unchanged
+ */
+bool PatternCompiler::setGeometry(const PatternGeometry &geometry) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!geometry.isValid(mTicksPerBeat)) {
+        LOGE("Unsupported pattern geometry: %d steps, %d steps per beat, %d tracks",
+             geometry.numSteps, geometry.stepsPerBeat, geometry.numTracks);
+        return false;
+    }
+    editPattern().geometry = geometry;
+    markDirty(1u << mEditPatternIdx);
+    return true;
+}
+
+PatternGeometry PatternCompiler::getGeometry() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return editPattern().geometry;
+}
+
+/**
+ * Change the swing and micro-timing of the pattern, takes effect from the next round of the loop
+ *
+ * @return false if the groove is out of range, the pattern is then unchanged
+ */
+bool PatternCompiler::setGroove(const Groove &groove) {
+    if (!groove.isValid()) {
+        LOGE("Unsupported groove, swing: %d", groove.swing);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mLock);
+    editPattern().groove = groove;
+    markDirty(1u << mEditPatternIdx);
+    return true;
+}
+
+/**
+ * Set the rate of the audio stream, which BeatClock ticks are derived from, and recompile every
+ * pattern. A pattern whose steps no longer land on whole ticks goes back to the default geometry.
+ */
+void PatternCompiler::setSampleRate(int32_t sampleRate) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mTicksPerBeat = BeatClock::ticksPerBeat(sampleRate);
+    for (int p = 0; p < kMaxPatterns; p++) {
+        if (!mPatterns[p].geometry.isValid(mTicksPerBeat)) {
+            LOGW("Pattern %d doesn't fit %d Hz, resetting its geometry", p, sampleRate);
+            mPatterns[p].geometry = PatternGeometry();
+        }
+    }
+    markDirty((1u << kMaxPatterns) - 1);
+}
+
+/**
+ * Only schedule metronome events, ignoring the beat map
+ */
+void PatternCompiler::setMetronomeOnly(bool metronomeOnly) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mMetronomeOnly = metronomeOnly;
+    markDirty((1u << kMaxPatterns) - 1);
+}
+
+/**
+ * Must be called with mLock held
+ *
+ * @param patterns - one bit for each pattern which needs a new schedule
+ */
+void PatternCompiler::markDirty(uint32_t patterns) {
+    mDirtyPatterns |= patterns;
+    mCondition.notify_one();
+}
+
+/**
+ * Compiler thread, rebuilds the schedule whenever the pattern changes
+ */
+void PatternCompiler::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mCondition.wait(lock, [this] { return mDirtyPatterns != 0 || !mIsRunning; });
+        if (!mIsRunning) return;
+
+        lock.unlock();
+        compile();
+        lock.lock();
+    }
+}
+
+/**
+ * Build schedules for the changed patterns and publish them for the audio thread. Normally done by
+ * the compiler thread, but can be called directly to have every schedule ready before playback
+ * starts.
+ */
+void PatternCompiler::compile() {
+    std::lock_guard<std::mutex> compileLock(mCompileLock);
+
+    while (true) {
+        PatternSchedule *schedule = takeFreeSchedule();
+        int patternIdx;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (mDirtyPatterns == 0) {
+                mSpare = schedule;
+                return;
+            }
+            patternIdx = __builtin_ctz(mDirtyPatterns);
+            mDirtyPatterns &= mDirtyPatterns - 1;
+            buildSchedule(mPatterns[patternIdx], *schedule);
+        }
+
+        // If the audio thread hasn't picked up the previous schedule yet, it is simply replaced
+        mSpare = mPublished[patternIdx].exchange(schedule);
+
+        LOGD("[PatternCompiler] published %d events for pattern %d", schedule->numEvents,
+             patternIdx);
+        printBeatMap(patternIdx);
+    }
+}
+
+/**
+ * Called by the audio thread at the start of a loop. Never blocks, and the schedule it returns
+ * stays valid until the next call for the same pattern.
+ *
+ * @param patternIdx - pattern which is about to be played
+ * @return the newest schedule of the pattern
+ */
+const PatternSchedule *PatternCompiler::acquireSchedule(int patternIdx) {
+    PatternSchedule *next = mPublished[patternIdx].exchange(nullptr);
+    if (next != nullptr) {
+        if (mPlaying[patternIdx] != nullptr) {
+            mRetired.push(mPlaying[patternIdx]);
+        }
+        mPlaying[patternIdx] = next;
+    }
+    return mPlaying[patternIdx];
+}
+
+/**
+ * Get a schedule nobody else is using. The audio thread and mPublished hold at most two per
+ * pattern, so the one we need is either the spare or on its way back from the audio thread.
+ */
+PatternSchedule *PatternCompiler::takeFreeSchedule() {
+    PatternSchedule *schedule = mSpare;
+    mSpare = nullptr;
+    while (schedule == nullptr && !mRetired.pop(schedule)) {
+        std::this_thread::yield();
+    }
+    return schedule;
+}
+
+/**
+ * Read the beat map of a pattern and write the events of one loop, in tick order. Must be called
+ * with mLock held.
+ */
+void PatternCompiler::buildSchedule(const Pattern &pattern, PatternSchedule &schedule) {
+    const PatternGeometry &geometry = pattern.geometry;
+    const Groove &groove = pattern.groove;
+
+    // Positions are in BeatClock ticks, which don't depend on the tempo. The audio thread turns
+    // them into frames as it plays, so a tempo change never needs a new schedule.
+    const int64_t ticksPerStep = mTicksPerBeat / geometry.stepsPerBeat;
+
+    schedule.loopTicks = geometry.numSteps * ticksPerStep;
+    schedule.numSteps = geometry.numSteps;
+    schedule.stepsPerBeat = geometry.stepsPerBeat;
+    schedule.ticksPerStep = ticksPerStep;
+    schedule.numEvents = 0;
+
+    // Work out the groove once per step. With the offsets folded into the events, the audio thread
+    // never knows there is a groove at all.
+    for (int j = 0; j < geometry.numSteps; j++) {
+        int64_t offset = groove.microTiming[j] * ticksPerStep / kMicroTimingResolution;
+        if (j % 2 == 1) {
+            offset += (groove.swing - kStraightSwing) * ticksPerStep / kStraightSwing;
+        }
+        mStepOffsets[j] = offset;
+    }
+
+    // the common shapes get their own instantiation
+    if (geometry.numSteps == 16 && geometry.numTracks == 8) {
+        buildEvents(FixedPatternShape<16, 8>(), pattern, ticksPerStep, schedule);
+    } else if (geometry.numSteps == 32 && geometry.numTracks == 8) {
+        buildEvents(FixedPatternShape<32, 8>(), pattern, ticksPerStep, schedule);
+    } else {
+        buildEvents(DynamicPatternShape{geometry.numSteps, geometry.numTracks}, pattern,
+                    ticksPerStep, schedule);
+    }
+    sortEvents(schedule);
+}
+
+template<typename Shape>
+void PatternCompiler::buildEvents(const Shape &shape, const Pattern &pattern,
+                                  int64_t ticksPerStep, PatternSchedule &schedule) {
+    const int stepsPerBeat = pattern.geometry.stepsPerBeat;
+    const uint64_t tracks = mMetronomeOnly ? 0 : trackMask(shape.numTracks());
+    const int64_t loopTicks = schedule.loopTicks;
+    for (int j = 0; j < shape.numSteps(); j++) {
+        // an early hit on the first step is played at the end of the loop, and a late one on the
+        // last step at the start, so that it keeps its timing relative to the next round
+        const int64_t tick = ((j * ticksPerStep + mStepOffsets[j]) % loopTicks + loopTicks) %
+                             loopTicks;
+        // visit only the tracks playing on this step, lowest track first
+        for (uint64_t step = pattern.beatMap[j] & tracks; step != 0; step &= step - 1) {
+            int i = __builtin_ctzll(step);
+            schedule.events[schedule.numEvents++] = {tick, i, pattern.velocity[j][i],
+                                                     pattern.pan[j][i], false};
+        }
+        // always add metronome events, once per beat
+        if (j % stepsPerBeat == 0) {
+            schedule.events[schedule.numEvents++] = {j * ticksPerStep, kMetronomeTrackIdx,
+                                                     kMaxVelocity, kCenterPan, true};
+        }
+    }
+}
+
+/**
+ * Put the events back in tick order after the groove has moved them. They are almost sorted
+ * already, so an insertion sort only shifts the few events which changed places.
+ */
+void PatternCompiler::sortEvents(PatternSchedule &schedule) {
+    for (int i = 1; i < schedule.numEvents; i++) {
+        PlayerEvent event = schedule.events[i];
+        int j = i;
+        while (j > 0 && schedule.events[j - 1].tick > event.tick) {
+            schedule.events[j] = schedule.events[j - 1];
+            j--;
+        }
+        schedule.events[j] = event;
+    }
+}
+
+/**
+ * Print out beat arragements in all channels
+ */
+void PatternCompiler::printBeatMap(int patternIdx) {
+    std::lock_guard<std::mutex> lock(mLock);
+    const Pattern &pattern = mPatterns[patternIdx];
+    LOGD("[beatMap] pattern %d", patternIdx);
+    for (int i = 0; i < pattern.geometry.numTracks; i++) {
+        std::string output = "ch" + std::to_string(i);
+        for (int j = 0; j < pattern.geometry.numSteps; j++) {
+            if ((pattern.beatMap[j] & (uint64_t(1) << i)) == 0) {
+                output += "[ ]";
+            } else {
+                output += "[x]";
+            }
+        }
+        LOGD("%s", output.c_str());
+    }
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRUMMACHINE_PATTERNCOMPILER_H
+#define DRUMMACHINE_PATTERNCOMPILER_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "audio/GainTables.h"
+#include "utils/LockFreeQueue.h"
+#include "BeatClock.h"
+#include "DrumMachineConstants.h"
+
+/**
+ * Shape of the pattern grid, chosen at runtime
+ *
+ * A pattern is numSteps long and each beat is split into stepsPerBeat steps, e.g. 2 for an eighth
+ * note grid, 4 for sixteenths or 3 for triplets. Track i of the pattern plays sample i of the kit.
+ */
+struct PatternGeometry {
+    int numSteps = kDefaultNumSteps;
+    int stepsPerBeat = kDefaultStepsPerBeat;
+    int numTracks = kDefaultNumPatternTracks;
+
+    bool isValid(int64_t ticksPerBeat) const;
+};
+
+/**
+ * Timing feel of a pattern, folded into the event positions when the schedule is compiled
+ *
+ * swing is where the second step of every pair falls, as a percentage of the pair: 50 is straight,
+ * 66 a triplet shuffle. microTiming moves single steps early (negative) or late (positive), in
+ * 1/kMicroTimingResolution of a step. The metronome always stays on the grid.
+ */
+struct Groove {
+    int swing = kStraightSwing;
+    int16_t microTiming[kMaxSteps] = { 0 };
+
+    bool isValid() const;
+};
+
+/**
+ * A pattern shape fixed at compile time, so that the loops over the beat map unroll
+ */
+template<int kNumSteps, int kNumTracks>
+struct FixedPatternShape {
+    constexpr int numSteps() const { return kNumSteps; }
+    constexpr int numTracks() const { return kNumTracks; }
+};
+
+/**
+ * @return a step mask with the bits of the first numTracks tracks set
+ */
+constexpr uint64_t trackMask(int numTracks) {
+    return numTracks >= 64 ? ~uint64_t(0) : (uint64_t(1) << numTracks) - 1;
+}
+
+/**
+ * Any other pattern shape
+ */
+struct DynamicPatternShape {
+    int steps;
+    int tracks;
+
+    int numSteps() const { return steps; }
+    int numTracks() const { return tracks; }
+};
+
+/**
+ * A sample to be triggered at a given position of the current loop, in BeatClock ticks
+ */
+struct PlayerEvent {
+    int64_t tick;
+    int trackIdx;
+    uint8_t velocity;
+    uint8_t pan;
+    bool isMetronome; // muted unless the metronome is on, whatever trackIdx it plays
+};
+
+/**
+ * One pattern of the song, everything needed to compile its schedule
+ */
+struct Pattern {
+    PatternGeometry geometry;
+    Groove groove;
+    // one bit per track for every step, bit i set if track i plays on that step
+    uint64_t beatMap[kMaxSteps] = { 0 };
+    // how each beat set in beatMap is played
+    uint8_t velocity[kMaxSteps][kMaxPatternTracks] = {{ 0 }};
+    uint8_t pan[kMaxSteps][kMaxPatternTracks] = {{ 0 }};
+};
+
+/**
+ * Everything the audio callback needs to play one loop of the pattern
+ */
+struct PatternSchedule {
+    std::array<PlayerEvent, kMaxPlayerEvents> events; // sorted by tick
+    int numEvents = 0;
+    int64_t loopTicks = 0;
+    // the step grid the schedule was compiled for, a live hit is quantised to it
+    int numSteps = kDefaultNumSteps;
+    int stepsPerBeat = kDefaultStepsPerBeat;
+    int64_t ticksPerStep = 0;
+};
+
+/**
+ * Owns the patterns and turns them into PatternSchedules on a background thread, so that no
+ * allocation, logging or beat map scan happens on the audio thread.
+ *
+ * Every pattern always has a compiled schedule, so the audio thread can switch to any of them at
+ * the end of a loop. Two schedules per pattern plus one are preallocated: for each pattern the
+ * audio thread holds the latest one it picked up, at most one is published and waiting to be
+ * picked up, and the compiler builds into the remaining one. A new schedule is handed over with a
+ * single atomic pointer exchange, and the schedule it replaces comes back to the compiler through
+ * a LockFreeQueue.
+ */
+class PatternCompiler {
+public:
+    PatternCompiler();
+    ~PatternCompiler();
+
+    // Pattern edits, from any non real-time thread. They apply to the pattern selected with
+    // setEditPattern and each one schedules a recompile.
+    bool setEditPattern(int patternIdx);
+    void setBeat(int trackIdx, int beatIdx, uint8_t velocity = kMaxVelocity,
+                 uint8_t pan = kCenterPan);
+    void resetTrack(int trackIdx);
+    void resetAll();
+    void setMetronomeOnly(bool metronomeOnly);
+    bool setGeometry(const PatternGeometry &geometry);
+    PatternGeometry getGeometry();
+    bool setGroove(const Groove &groove);
+    void setSampleRate(int32_t sampleRate);
+
+    void compile();
+    const PatternSchedule *acquireSchedule(int patternIdx);
+
+private:
+    void run();
+    PatternSchedule *takeFreeSchedule();
+    void buildSchedule(const Pattern &pattern, PatternSchedule &schedule);
+    template<typename Shape>
+    void buildEvents(const Shape &shape, const Pattern &pattern, int64_t ticksPerStep,
+                     PatternSchedule &schedule);
+    void sortEvents(PatternSchedule &schedule);
+    void printBeatMap(int patternIdx);
+    void markDirty(uint32_t patterns);
+    Pattern &editPattern() { return mPatterns[mEditPatternIdx]; }
+
+    static constexpr int kNumSchedules = 2 * kMaxPatterns + 1;
+    std::array<PatternSchedule, kNumSchedules> mSchedules;
+    std::array<std::atomic<PatternSchedule*>, kMaxPatterns> mPublished;
+    LockFreeQueue<PatternSchedule*, 32> mRetired;
+    PatternSchedule *mSpare = nullptr;
+    // latest schedule of each pattern picked up by the audio thread, only touched by that thread
+    std::array<PatternSchedule*, kMaxPatterns> mPlaying;
+
+    // mLock guards the patterns below, mCompileLock makes sure only one thread builds at a time
+    std::mutex mLock;
+    std::mutex mCompileLock;
+    std::condition_variable mCondition;
+    uint32_t mDirtyPatterns = 0; // one bit per pattern
+    bool mIsRunning = true;
+    std::array<Pattern, kMaxPatterns> mPatterns;
+    int mEditPatternIdx = 0;
+    bool mMetronomeOnly = false;
+    int64_t mTicksPerBeat = BeatClock::ticksPerBeat(kDefaultSampleRateHz);
+    int64_t mStepOffsets[kMaxSteps] = { 0 }; // groove in ticks, scratch space for buildSchedule
+
+    std::thread mThread;
+};
+
+#endif //DRUMMACHINE_PATTERNCOMPILER_H
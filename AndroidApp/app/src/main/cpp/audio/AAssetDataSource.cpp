@@ -17,11 +17,13 @@
 
 #include <utils/logging.h>
 #include "AAssetDataSource.h"
+#include "WavDecoder.h"
 
 
 AAssetDataSource* AAssetDataSource::newFromAssetManager(AAssetManager &assetManager,
                                                         const char *filename,
-                                                        const int32_t channelCount) {
+                                                        const int32_t channelCount,
+                                                        const int32_t sampleRate) {
 
     // Load the backing track
     AAsset* asset = AAssetManager_open(&assetManager, filename, AASSET_MODE_BUFFER);
@@ -31,19 +33,29 @@ AAssetDataSource* AAssetDataSource::newFromAssetManager(AAssetManager &assetMana
         return nullptr;
     }
 
-    // Get the length of the track (we assume it is stereo 48kHz)
     off_t trackSizeInBytes = AAsset_getLength(asset);
+    auto *fileData = static_cast<const uint8_t*>(AAsset_getBuffer(asset));
 
-    // Load it into memory
-    auto *audioBuffer = static_cast<const int16_t*>(AAsset_getBuffer(asset));
-
-    if (audioBuffer == nullptr){
+    if (fileData == nullptr){
         LOGE("Could not get buffer for track");
+        AAsset_close(asset);
         return nullptr;
     }
 
-    auto numFrames = static_cast<int32_t>(trackSizeInBytes / (sizeof(int16_t) * channelCount));
-    LOGD("Opened audio data source, bytes: %ld frames: %d", trackSizeInBytes, numFrames);
+    // Decode it once into memory, the asset isn't needed after that
+    std::vector<int16_t> audioBuffer;
+    WavInfo info;
+    bool isDecoded = WavDecoder::decode(fileData, static_cast<size_t>(trackSizeInBytes), channelCount,
+                                        sampleRate, audioBuffer, &info);
+    AAsset_close(asset);
+    if (!isDecoded){
+        LOGE("Could not decode %s", filename);
+        return nullptr;
+    }
+    auto numFrames = static_cast<int32_t>(audioBuffer.size() / channelCount);
+    LOGD("Opened audio data source %s, %d Hz %d bit%s %d channels, frames: %d => %d at %d Hz",
+         filename, info.sampleRate, info.bitsPerSample, info.isFloat ? " float" : "",
+         info.channelCount, info.numFrames, numFrames, sampleRate);
 
-    return new AAssetDataSource(asset, audioBuffer, numFrames, channelCount);
+    return new AAssetDataSource(std::move(audioBuffer), numFrames, channelCount);
 }
@@ -13,41 +13,37 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
-
 #ifndef DRUMMACHINE_AASSETDATASOURCE_H
 #define DRUMMACHINE_AASSETDATASOURCE_H
 
 #include <android/asset_manager.h>
+#include <vector>
+
 #include "DataSource.h"
 
+/**
+ * A WAV asset, decoded into memory in the engine's format when it is loaded
+ */
 class AAssetDataSource : public DataSource {
 
 public:
 
-    ~AAssetDataSource(){
-
-        // Note that this will also delete the data at mBuffer
-        AAsset_close(mAsset);
-    }
-
     int32_t getTotalFrames() const override { return mTotalFrames; } ;
     int32_t getChannelCount() const override { return mChannelCount; } ;
-    const int16_t* getData() const override { return mBuffer;	};
+    const int16_t* getData() const override { return mBuffer.data(); };
 
-    static AAssetDataSource* newFromAssetManager(AAssetManager&, const char *, const int32_t);
+    static AAssetDataSource* newFromAssetManager(AAssetManager&, const char *, const int32_t,
+                                                 const int32_t);
 
 private:
 
-    AAssetDataSource(AAsset *asset, const int16_t *data, int32_t frames,
-                     int32_t channelCount)
-            : mAsset(asset)
-            , mBuffer(data)
+    AAssetDataSource(std::vector<int16_t> &&buffer, int32_t frames, int32_t channelCount)
+            : mBuffer(std::move(buffer))
             , mTotalFrames(frames)
             , mChannelCount(channelCount) {
     };
 
-    AAsset *mAsset = nullptr;
-    const int16_t* mBuffer;
+    const std::vector<int16_t> mBuffer;
     const int32_t mTotalFrames;
     const int32_t mChannelCount;
 
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DRUMMACHINE_AASSETSAMPLEPROVIDER_H
+#define DRUMMACHINE_AASSETSAMPLEPROVIDER_H
+
+#include <android/asset_manager.h>
+
+#include <unistd.h>
+
+#include "AAssetDataSource.h"
+#include "StreamedDataSource.h"
+#include "SampleProvider.h"
+
+/**
+ * Loads samples from the APK assets
+ */
+class AAssetSampleProvider : public SampleProvider {
+public:
+    /**
+     * @param assetManager - where the samples are
+     * @param prefetcher - if set, samples which are stored uncompressed in the APK are streamed
+     *                     rather than decoded into memory if they are long and already in the
+     *                     engine's format, or ADPCM
+     */
+    explicit AAssetSampleProvider(AAssetManager &assetManager,
+                                  std::shared_ptr<SamplePrefetcher> prefetcher = nullptr)
+            : mAssetManager(assetManager)
+            , mPrefetcher(std::move(prefetcher)) {}
+
+    std::shared_ptr<DataSource> loadSample(const std::string &name, int32_t channelCount,
+                                           int32_t sampleRate) override {
+        if (mPrefetcher != nullptr) {
+            StreamedDataSource *source = streamAsset(name.c_str(), channelCount, sampleRate);
+            if (source != nullptr) return std::shared_ptr<DataSource>(source);
+        }
+        return std::shared_ptr<DataSource>(AAssetDataSource::newFromAssetManager(
+                mAssetManager, name.c_str(), channelCount, sampleRate));
+    }
+
+private:
+    StreamedDataSource* streamAsset(const char *name, int32_t channelCount, int32_t sampleRate) {
+        AAsset *asset = AAssetManager_open(&mAssetManager, name, AASSET_MODE_STREAMING);
+        if (asset == nullptr) return nullptr;
+        // only works for assets stored uncompressed, see noCompress in build.gradle
+        off_t start = 0;
+        off_t length = 0;
+        int fd = AAsset_openFileDescriptor(asset, &start, &length);
+        AAsset_close(asset);
+        if (fd < 0) return nullptr;
+        StreamedDataSource *source = StreamedDataSource::newFromFd(
+                fd, start, static_cast<size_t>(length), name, channelCount, sampleRate, mPrefetcher);
+        close(fd);
+        return source;
+    }
+
+    AAssetManager &mAssetManager;
+    const std::shared_ptr<SamplePrefetcher> mPrefetcher;
+};
+
+#endif //DRUMMACHINE_AASSETSAMPLEPROVIDER_H
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/mman.h>
+#include <algorithm>
+#include <utils/logging.h>
+
+#include "AdpcmDataSource.h"
+
+/**
+ * Stream a compressed WAV file
+ *
+ * @param audio - the audio found by WavDecoder::parse, copied
+ * @return the sample, or nullptr if it needs converting or is too short to be worth streaming
+ */
+AdpcmDataSource* AdpcmDataSource::newFromWav(const uint8_t *audio, size_t audioBytes,
+                                             const WavInfo &info, const char *name,
+                                             int32_t channelCount, int32_t sampleRate,
+                                             std::shared_ptr<SamplePrefetcher> prefetcher) {
+    // frames must not straddle the pages which are filled in and dropped
+    size_t frameBytes = channelCount * sizeof(int16_t);
+    if (!info.isAdpcm || info.channelCount != channelCount || info.sampleRate != sampleRate ||
+        pageSize() % frameBytes != 0) {
+        return nullptr;
+    }
+
+    size_t decodedBytes = static_cast<size_t>(info.numFrames) * frameBytes;
+    size_t decodedLength = (decodedBytes + pageSize() - 1) / pageSize() * pageSize();
+    void *decoded = mmap(nullptr, decodedLength, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (decoded == MAP_FAILED) {
+        LOGE("Could not allocate the decoded audio of %s", name);
+        return nullptr;
+    }
+    auto *data = static_cast<int16_t*>(decoded);
+    size_t headLength = StreamedDataSource::headLength(static_cast<uint8_t*>(decoded), data,
+                                                       info.numFrames, channelCount, sampleRate);
+    if (headLength + audioBytes >= decodedLength) {
+        // too short to save anything by streaming
+        munmap(decoded, decodedLength);
+        return nullptr;
+    }
+
+    LOGD("Streaming ADPCM data source %s, %d Hz %d channels, frames: %d, %zu KB compressed",
+         name, info.sampleRate, info.channelCount, info.numFrames, audioBytes / 1024);
+    return new AdpcmDataSource(std::vector<uint8_t>(audio, audio + audioBytes), info, data,
+                               decodedLength, headLength, std::move(prefetcher));
+}
+
+AdpcmDataSource::AdpcmDataSource(std::vector<uint8_t> &&blocks, const WavInfo &info,
+                                 int16_t *decoded, size_t decodedLength, size_t headLength,
+                                 std::shared_ptr<SamplePrefetcher> prefetcher)
+        : StreamedDataSource(std::move(prefetcher))
+        , mBlocks(std::move(blocks))
+        , mInfo(info)
+        , mDecoded(decoded)
+        , mDecodedLength(decodedLength)
+        , mHeadLength(headLength) {
+
+    // only the head is decoded for good, the tail is decoded once for the envelope and dropped
+    decodeBytes(0, mHeadLength);
+    lockPages(reinterpret_cast<uint8_t*>(mDecoded), mHeadLength);
+    startStreaming(reinterpret_cast<uint8_t*>(mDecoded) + mHeadLength, mDecodedLength - mHeadLength,
+                   mInfo.sampleRate);
+}
+
+AdpcmDataSource::~AdpcmDataSource() {
+    stopStreaming();
+    munmap(mDecoded, mDecodedLength);
+}
+
+void AdpcmDataSource::fillTail(size_t offset, size_t length) {
+    decodeBytes(mHeadLength + offset, length);
+}
+
+/**
+ * Decode the frames in a byte range of the decoded audio, which starts and ends on whole frames
+ */
+void AdpcmDataSource::decodeBytes(size_t offset, size_t length) {
+    const size_t frameBytes = mInfo.channelCount * sizeof(int16_t);
+    auto firstFrame = static_cast<int32_t>(offset / frameBytes);
+    int32_t numFrames = std::min(static_cast<int32_t>(length / frameBytes),
+                                 mInfo.numFrames - firstFrame);
+    if (numFrames <= 0) return;
+    WavDecoder::decodeAdpcm(mBlocks.data(), mBlocks.size(), mInfo, firstFrame, numFrames,
+                            mDecoded + static_cast<size_t>(firstFrame) * mInfo.channelCount);
+}
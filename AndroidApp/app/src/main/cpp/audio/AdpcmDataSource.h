@@ -0,0 +1,59 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRUMMACHINE_ADPCMDATASOURCE_H
+#define DRUMMACHINE_ADPCMDATASOURCE_H
+
+#include <vector>
+
+#include "StreamedDataSource.h"
+#include "WavDecoder.h"
+
+/**
+ * An IMA ADPCM WAV file at the engine's rate and channel count. Only the compressed audio, a quarter
+ * of the size, and the decoded head are kept in memory. The decoded tail is a cache which the
+ * SamplePrefetcher fills in just ahead of the play head when the sample is triggered, within the
+ * kit's kMaxPrefetchCacheBytes.
+ */
+class AdpcmDataSource : public StreamedDataSource {
+
+public:
+    ~AdpcmDataSource() override;
+
+    int32_t getTotalFrames() const override { return mInfo.numFrames; } ;
+    int32_t getChannelCount() const override { return mInfo.channelCount; } ;
+    const int16_t* getData() const override { return mDecoded; };
+    size_t getResidentBytes() const override { return mBlocks.size() + mHeadLength; };
+
+    static AdpcmDataSource* newFromWav(const uint8_t *audio, size_t audioBytes, const WavInfo &info,
+                                       const char *name, int32_t channelCount, int32_t sampleRate,
+                                       std::shared_ptr<SamplePrefetcher> prefetcher);
+
+private:
+    AdpcmDataSource(std::vector<uint8_t> &&blocks, const WavInfo &info, int16_t *decoded,
+                    size_t decodedLength, size_t headLength,
+                    std::shared_ptr<SamplePrefetcher> prefetcher);
+    void fillTail(size_t offset, size_t length) override;
+    void decodeBytes(size_t offset, size_t length);
+
+    const std::vector<uint8_t> mBlocks;
+    const WavInfo mInfo;
+    int16_t * const mDecoded; // anonymous mapping, so the tail can be dropped page by page
+    const size_t mDecodedLength;
+    const size_t mHeadLength;
+};
+
+#endif //DRUMMACHINE_ADPCMDATASOURCE_H
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DRUMMACHINE_AUDIOSINK_H
+#define DRUMMACHINE_AUDIOSINK_H
+
+#include <cstdint>
+
+/**
+ * Renders the next block of audio for an AudioSink, called on the sink's audio thread
+ */
+class AudioSinkCallback {
+public:
+    virtual ~AudioSinkCallback() = default;
+
+    /**
+     * @param audioData - interleaved output, float or int16_t
+     * @param isFloat - format of audioData
+     * @param numFrames - frames to render
+     */
+    virtual void onRenderAudio(void *audioData, bool isFloat, int32_t numFrames) = 0;
+};
+
+/**
+ * Where the engine's audio goes, and the clock it is rendered against: a device stream on Android,
+ * a null or WAV file sink on the host. A sink pulls audio from its callback until stopped.
+ */
+class AudioSink {
+public:
+    virtual ~AudioSink() = default;
+
+    virtual bool start(AudioSinkCallback *callback, int32_t sampleRate, int32_t channelCount) = 0;
+    virtual void stop() = 0;
+    virtual bool isRunning() const = 0;
+
+    // Rate the sink runs at without resampling, the engine renders and loads its samples at it
+    virtual int32_t getNativeSampleRate() = 0;
+
+    // Underruns since start, if the sink can tell. Called from the audio callback.
+    virtual int32_t getXRunCount() const { return 0; }
+};
+
+#endif //DRUMMACHINE_AUDIOSINK_H
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <vector>
+
+#include "CallbackTelemetry.h"
+
+void CallbackTelemetry::reset(int32_t sampleRate) {
+    mSampleRate = sampleRate;
+    mNumCallbacks.store(0, std::memory_order_relaxed);
+    mNumFrames.store(0, std::memory_order_relaxed);
+    mMinFramesRequested.store(0, std::memory_order_relaxed);
+    mMaxFramesRequested.store(0, std::memory_order_relaxed);
+    mXRunCount.store(0, std::memory_order_relaxed);
+    mNumLateCallbacks.store(0, std::memory_order_relaxed);
+    for (auto &bucket : mDurationHistogram) bucket.store(0, std::memory_order_relaxed);
+    for (auto &nanos : mRecentNanos) nanos.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Add one callback to the stats
+ *
+ * @param durationNanos - time spent in the callback
+ * @param numFrames - frames the callback rendered
+ * @param xRunCount - total underruns the audio sink has reported so far
+ */
+void CallbackTelemetry::record(int64_t durationNanos, int32_t numFrames, int32_t xRunCount) {
+    auto nanos = static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(durationNanos, 0), UINT32_MAX));
+    int64_t callbackIdx = mNumCallbacks.load(std::memory_order_relaxed);
+
+    mRecentNanos[callbackIdx & (kRecentCallbacks - 1)].store(nanos, std::memory_order_relaxed);
+
+    // the bucket is the bit length of the duration in microseconds
+    uint32_t micros = nanos / 1000;
+    int bucket = micros == 0 ? 0 : std::min(32 - __builtin_clz(micros), kNumDurationBuckets - 1);
+    auto &count = mDurationHistogram[bucket];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    if (callbackIdx == 0 || numFrames < mMinFramesRequested.load(std::memory_order_relaxed)) {
+        mMinFramesRequested.store(numFrames, std::memory_order_relaxed);
+    }
+    if (numFrames > mMaxFramesRequested.load(std::memory_order_relaxed)) {
+        mMaxFramesRequested.store(numFrames, std::memory_order_relaxed);
+    }
+    if (mSampleRate > 0 && durationNanos * mSampleRate > numFrames * INT64_C(1000000000)) {
+        mNumLateCallbacks.store(mNumLateCallbacks.load(std::memory_order_relaxed) + 1,
+                                std::memory_order_relaxed);
+    }
+    mXRunCount.store(xRunCount, std::memory_order_relaxed);
+    mNumFrames.store(mNumFrames.load(std::memory_order_relaxed) + numFrames, std::memory_order_relaxed);
+
+    // publishes the ring entry above
+    mNumCallbacks.store(callbackIdx + 1, std::memory_order_release);
+}
+
+/**
+ * Take a snapshot of the stats. The fields are read one at a time while the audio thread carries
+ * on, so they may be a callback apart from each other.
+ */
+CallbackStats CallbackTelemetry::getStats() const {
+    CallbackStats stats;
+    stats.numCallbacks = mNumCallbacks.load(std::memory_order_acquire);
+    stats.numFrames = mNumFrames.load(std::memory_order_relaxed);
+    stats.minFramesRequested = mMinFramesRequested.load(std::memory_order_relaxed);
+    stats.maxFramesRequested = mMaxFramesRequested.load(std::memory_order_relaxed);
+    stats.xRunCount = mXRunCount.load(std::memory_order_relaxed);
+    stats.numLateCallbacks = mNumLateCallbacks.load(std::memory_order_relaxed);
+    for (int i = 0; i < kNumDurationBuckets; i++) {
+        stats.durationHistogram[i] = mDurationHistogram[i].load(std::memory_order_relaxed);
+    }
+
+    auto numRecent = static_cast<int>(std::min<int64_t>(stats.numCallbacks, kRecentCallbacks));
+    if (numRecent == 0) return stats;
+    std::vector<uint32_t> recent(static_cast<size_t>(numRecent));
+    for (int i = 0; i < numRecent; i++) {
+        recent[i] = mRecentNanos[i].load(std::memory_order_relaxed);
+    }
+    auto percentile = [&recent](int percent) {
+        auto nth = recent.begin() + (recent.size() - 1) * percent / 100;
+        std::nth_element(recent.begin(), nth, recent.end());
+        return static_cast<int64_t>(*nth);
+    };
+    stats.p50Nanos = percentile(50);
+    stats.p99Nanos = percentile(99);
+    stats.maxNanos = percentile(100);
+    return stats;
+}
+
+/**
+ * One line summary for logs and the UI, followed by the non-empty histogram buckets
+ */
+std::string CallbackStats::toString() const {
+    char line[256];
+    snprintf(line, sizeof(line),
+             "callbacks %" PRId64 ", frames %" PRId64 " (%d-%d per callback), xruns %d, late %" PRId64
+             ", duration p50 %.1f us p99 %.1f us max %.1f us",
+             numCallbacks, numFrames, minFramesRequested, maxFramesRequested, xRunCount,
+             numLateCallbacks, p50Nanos / 1000.0, p99Nanos / 1000.0, maxNanos / 1000.0);
+    std::string text = line;
+    for (int i = 0; i < kNumDurationBuckets; i++) {
+        if (durationHistogram[i] == 0) continue;
+        snprintf(line, sizeof(line), "\n  < %u us: %u", 1u << i, durationHistogram[i]);
+        text += line;
+    }
+    return text;
+}
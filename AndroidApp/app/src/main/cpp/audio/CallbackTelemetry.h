@@ -0,0 +1,78 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DRUMMACHINE_CALLBACKTELEMETRY_H
+#define DRUMMACHINE_CALLBACKTELEMETRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+constexpr int kNumDurationBuckets = 24; // bucket i counts callbacks of [2^(i-1), 2^i) us, 0 under 1us
+constexpr int kRecentCallbacks = 1024; // callbacks the percentiles are taken over, a power of 2
+
+/**
+ * A snapshot of the audio callback timing since the stream was started
+ */
+struct CallbackStats {
+    int64_t numCallbacks = 0;
+    int64_t numFrames = 0;
+    int32_t minFramesRequested = 0;
+    int32_t maxFramesRequested = 0;
+    int32_t xRunCount = 0; // underruns reported by the audio sink
+    int64_t numLateCallbacks = 0; // callbacks which took longer than the audio they rendered
+
+    // callback duration over the last kRecentCallbacks callbacks
+    int64_t p50Nanos = 0;
+    int64_t p99Nanos = 0;
+    int64_t maxNanos = 0;
+
+    uint32_t durationHistogram[kNumDurationBuckets] = {};
+
+    std::string toString() const;
+};
+
+/**
+ * Records how long each audio callback takes. record() is wait free and only does a handful of
+ * relaxed stores, so it is cheap enough to leave on in production. Any thread can take a snapshot
+ * with getStats() while the audio thread keeps recording.
+ */
+class CallbackTelemetry {
+public:
+    CallbackTelemetry() { reset(0); }
+
+    // Clear the stats, only while the audio thread is stopped
+    void reset(int32_t sampleRate);
+
+    // Audio thread only
+    void record(int64_t durationNanos, int32_t numFrames, int32_t xRunCount);
+
+    CallbackStats getStats() const;
+
+private:
+    int32_t mSampleRate = 0;
+
+    // Written by the audio thread only, so plain load and store pairs are enough
+    std::atomic<int64_t> mNumCallbacks;
+    std::atomic<int64_t> mNumFrames;
+    std::atomic<int32_t> mMinFramesRequested;
+    std::atomic<int32_t> mMaxFramesRequested;
+    std::atomic<int32_t> mXRunCount;
+    std::atomic<int64_t> mNumLateCallbacks;
+    std::atomic<uint32_t> mDurationHistogram[kNumDurationBuckets];
+    std::atomic<uint32_t> mRecentNanos[kRecentCallbacks]; // ring, indexed by callback count
+};
+
+#endif //DRUMMACHINE_CALLBACKTELEMETRY_H
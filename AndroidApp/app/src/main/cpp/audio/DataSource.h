@@ -17,7 +17,13 @@
 #ifndef DRUMMACHINE_AUDIOSOURCE_H
 #define DRUMMACHINE_AUDIOSOURCE_H
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+constexpr int32_t kEnvelopeBlockFrames = 256; // Resolution of the loudness envelope used for stealing
 
 class DataSource {
 public:
@@ -25,6 +31,52 @@ public:
     virtual int32_t getTotalFrames() const = 0;
     virtual int32_t getChannelCount() const  = 0;
     virtual const int16_t* getData() const = 0;
+
+    // Memory held while the sample isn't playing
+    virtual size_t getResidentBytes() const {
+        return static_cast<size_t>(getTotalFrames()) * getChannelCount() * sizeof(int16_t);
+    };
+
+    // Called on the audio thread whenever playback starts again from the first frame. Sources which
+    // are not fully resident page the rest of their data in ahead of the play head. Must not block.
+    virtual void prefetch() {};
+
+    // Peak level of every kEnvelopeBlockFrames frames. Reads the whole sample, sources which are not
+    // fully resident override this so that it doesn't page all of their data in.
+    virtual std::vector<int16_t> getEnvelope() const {
+        std::vector<int16_t> envelope(
+                static_cast<size_t>(getTotalFrames() / kEnvelopeBlockFrames + 1), 0);
+        addToEnvelope(envelope, getData(), 0, getTotalFrames(), getChannelCount());
+        return envelope;
+    };
+
+    // Frames from the start which can be read right now, the audio thread plays silence past them.
+    // Called once per rendered block, sources which are fully resident have all of them.
+    virtual int32_t getReadableFrames() const { return getTotalFrames(); };
+
+    // Time it takes the prefetch thread to fill in the whole of the sample which is not resident,
+    // 0 if all of it is
+    virtual double getTailFillMillis() const { return 0; };
+
+    // Keep all of the sample resident while pinned, for renders which run faster than real time and
+    // so would get ahead of the prefetch thread. Pinning may block, don't call it on the audio thread.
+    virtual void setPinned(bool isPinned) { (void) isPinned; };
+
+protected:
+    /**
+     * Raise the envelope to the peaks of frames [firstFrame, firstFrame + numFrames) of data
+     */
+    static void addToEnvelope(std::vector<int16_t> &envelope, const int16_t *data,
+                              int32_t firstFrame, int32_t numFrames, int32_t channelCount) {
+        for (int32_t f = firstFrame; f < firstFrame + numFrames; ++f) {
+            int16_t &peak = envelope[f / kEnvelopeBlockFrames];
+            for (int32_t c = 0; c < channelCount; ++c) {
+                int32_t sample = data[static_cast<size_t>(f) * channelCount + c];
+                auto level = static_cast<int16_t>(std::min(std::abs(sample), INT16_MAX));
+                if (level > peak) peak = level;
+            }
+        }
+    }
 };
 
 
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cstdio>
+#include <utils/logging.h>
+
+#include "FileDataSource.h"
+#include "WavDecoder.h"
+
+/**
+ * Load a WAV file and decode it into memory, like AAssetDataSource
+ *
+ * @return the sample, or nullptr if the file can't be read or decoded
+ */
+FileDataSource* FileDataSource::newFromFile(const char *path, const int32_t channelCount,
+                                            const int32_t sampleRate) {
+
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr){
+        LOGE("Failed to open track, filename %s", path);
+        return nullptr;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long trackSizeInBytes = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (trackSizeInBytes < 0){
+        LOGE("Could not get the length of %s", path);
+        fclose(file);
+        return nullptr;
+    }
+
+    std::vector<uint8_t> fileData(static_cast<size_t>(trackSizeInBytes));
+    size_t numRead = fread(fileData.data(), 1, fileData.size(), file);
+    fclose(file);
+    if (numRead != fileData.size()){
+        LOGE("Could not read %s", path);
+        return nullptr;
+    }
+
+    std::vector<int16_t> audioBuffer;
+    WavInfo info;
+    if (!WavDecoder::decode(fileData.data(), fileData.size(), channelCount, sampleRate,
+                            audioBuffer, &info)){
+        LOGE("Could not decode %s", path);
+        return nullptr;
+    }
+    auto numFrames = static_cast<int32_t>(audioBuffer.size() / channelCount);
+    LOGD("Opened audio data source %s, %d Hz %d bit%s %d channels, frames: %d => %d at %d Hz",
+         path, info.sampleRate, info.bitsPerSample, info.isFloat ? " float" : "",
+         info.channelCount, info.numFrames, numFrames, sampleRate);
+
+    return new FileDataSource(std::move(audioBuffer), numFrames, channelCount);
+}
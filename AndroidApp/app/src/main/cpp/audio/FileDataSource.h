@@ -0,0 +1,48 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DRUMMACHINE_FILEDATASOURCE_H
+#define DRUMMACHINE_FILEDATASOURCE_H
+
+#include <vector>
+
+#include "DataSource.h"
+
+/**
+ * A WAV file decoded into memory, the host counterpart of AAssetDataSource
+ */
+class FileDataSource : public DataSource {
+
+public:
+    int32_t getTotalFrames() const override { return mTotalFrames; } ;
+    int32_t getChannelCount() const override { return mChannelCount; } ;
+    const int16_t* getData() const override { return mBuffer.data(); };
+
+    static FileDataSource* newFromFile(const char *path, int32_t channelCount, int32_t sampleRate);
+
+private:
+
+    FileDataSource(std::vector<int16_t> &&buffer, int32_t frames, int32_t channelCount)
+            : mBuffer(std::move(buffer))
+            , mTotalFrames(frames)
+            , mChannelCount(channelCount) {
+    };
+
+    const std::vector<int16_t> mBuffer;
+    const int32_t mTotalFrames;
+    const int32_t mChannelCount;
+
+};
+#endif //DRUMMACHINE_FILEDATASOURCE_H
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DRUMMACHINE_FILESAMPLEPROVIDER_H
+#define DRUMMACHINE_FILESAMPLEPROVIDER_H
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FileDataSource.h"
+#include "StreamedDataSource.h"
+#include "SampleProvider.h"
+
+/**
+ * Loads samples from a directory, e.g. app/src/main/assets, for running the engine on the host
+ */
+class FileSampleProvider : public SampleProvider {
+public:
+    /**
+     * @param directory - where the samples are
+     * @param prefetcher - if set, long samples which are already in the engine's format and
+     *                     ADPCM samples are streamed rather than decoded into memory
+     */
+    explicit FileSampleProvider(std::string directory,
+                                std::shared_ptr<SamplePrefetcher> prefetcher = nullptr)
+            : mDirectory(std::move(directory))
+            , mPrefetcher(std::move(prefetcher)) {}
+
+    std::shared_ptr<DataSource> loadSample(const std::string &name, int32_t channelCount,
+                                           int32_t sampleRate) override {
+        std::string path = mDirectory.empty() ? name : mDirectory + "/" + name;
+        if (mPrefetcher != nullptr) {
+            StreamedDataSource *source = streamFile(path.c_str(), channelCount, sampleRate);
+            if (source != nullptr) return std::shared_ptr<DataSource>(source);
+        }
+        return std::shared_ptr<DataSource>(
+                FileDataSource::newFromFile(path.c_str(), channelCount, sampleRate));
+    }
+
+private:
+    StreamedDataSource* streamFile(const char *path, int32_t channelCount, int32_t sampleRate) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat fileStat;
+        StreamedDataSource *source = nullptr;
+        if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+            source = StreamedDataSource::newFromFd(fd, 0, static_cast<size_t>(fileStat.st_size),
+                                                   path, channelCount, sampleRate, mPrefetcher);
+        }
+        close(fd);
+        return source;
+    }
+
+    const std::string mDirectory;
+    const std::shared_ptr<SamplePrefetcher> mPrefetcher;
+};
+
+#endif //DRUMMACHINE_FILESAMPLEPROVIDER_H
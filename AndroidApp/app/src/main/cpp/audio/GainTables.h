@@ -0,0 +1,90 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRUMMACHINE_GAINTABLES_H
+#define DRUMMACHINE_GAINTABLES_H
+
+#include <cstdint>
+
+constexpr int kNumVelocities = 128; // MIDI style velocity, 0 is silent
+constexpr uint8_t kMaxVelocity = kNumVelocities - 1;
+constexpr int kNumPanPositions = 129; // 0 is hard left, 128 hard right
+constexpr uint8_t kCenterPan = 64;
+
+/**
+ * Gains for velocity and pan, built at compile time so that a hit only costs two table lookups
+ */
+struct GainTables {
+    float velocity[kNumVelocities];
+    float panLeft[kNumPanPositions];
+    float panRight[kNumPanPositions];
+
+    constexpr GainTables() : velocity(), panLeft(), panRight() {
+        // 40 * log10(v / 127) dB, i.e. the square of the velocity, as recommended for General MIDI
+        for (int v = 0; v < kNumVelocities; ++v) {
+            float normalized = static_cast<float>(v) / kMaxVelocity;
+            velocity[v] = normalized * normalized;
+        }
+        // constant power: the pan position sweeps a quarter circle and left^2 + right^2 = 2. That
+        // keeps a centred hit at unity gain, as before pan existed, and a hard panned one is 3 dB
+        // louder on its side, which the mix bus limiter takes care of.
+        for (int p = 0; p < kNumPanPositions; ++p) {
+            double angle = kHalfPi * p / (kNumPanPositions - 1);
+            panLeft[p] = static_cast<float>(kSqrt2 * cosine(angle));
+            panRight[p] = static_cast<float>(kSqrt2 * cosine(kHalfPi - angle));
+        }
+    }
+
+private:
+    static constexpr double kHalfPi = 1.57079632679489661923;
+    static constexpr double kSqrt2 = 1.41421356237309504880;
+
+    /**
+     * Taylor series of cos, accurate to well below float precision on [0, pi / 2]
+     */
+    static constexpr double cosine(double x) {
+        double term = 1.0;
+        double sum = 1.0;
+        for (int n = 1; n < 12; ++n) {
+            term *= -x * x / ((2 * n - 1) * (2 * n));
+            sum += term;
+        }
+        return sum;
+    }
+};
+
+constexpr GainTables kGainTables;
+
+/**
+ * Left and right gain of a hit, velocity and pan combined
+ */
+struct StereoGain {
+    float left;
+    float right;
+};
+
+inline float velocityGain(uint8_t velocity) {
+    return kGainTables.velocity[velocity > kMaxVelocity ? kMaxVelocity : velocity];
+}
+
+inline StereoGain stereoGain(uint8_t velocity, uint8_t pan) {
+    if (velocity > kMaxVelocity) velocity = kMaxVelocity;
+    if (pan >= kNumPanPositions) pan = kNumPanPositions - 1;
+    float gain = kGainTables.velocity[velocity];
+    return { gain * kGainTables.panLeft[pan], gain * kGainTables.panRight[pan] };
+}
+
+#endif //DRUMMACHINE_GAINTABLES_H
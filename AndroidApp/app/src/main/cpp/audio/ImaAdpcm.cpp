@@ -0,0 +1,97 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "ImaAdpcm.h"
+
+constexpr int32_t kHeaderBytesPerChannel = 4; // first sample, step index, reserved byte
+constexpr int32_t kBytesPerChannelGroup = 4; // 8 samples of one channel before the next channel
+constexpr int32_t kSamplesPerGroup = 8;
+constexpr int32_t kMaxStepIndex = 88;
+constexpr int32_t kMaxChannels = 8;
+
+static const int16_t kStepTable[kMaxStepIndex + 1] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60,
+        66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371,
+        408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878,
+        2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845,
+        8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086,
+        29794, 32767 };
+
+static const int8_t kIndexTable[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+/**
+ * Decoding state of one channel
+ */
+struct AdpcmChannel {
+    int32_t predictor;
+    int32_t stepIndex;
+
+    int16_t decode(uint8_t nibble) {
+        int32_t step = kStepTable[stepIndex];
+        int32_t diff = step >> 3;
+        if (nibble & 1) diff += step >> 2;
+        if (nibble & 2) diff += step >> 1;
+        if (nibble & 4) diff += step;
+        predictor += (nibble & 8) ? -diff : diff;
+        predictor = std::max<int32_t>(INT16_MIN, std::min<int32_t>(INT16_MAX, predictor));
+        stepIndex = std::max(0, std::min(kMaxStepIndex, stepIndex + kIndexTable[nibble]));
+        return static_cast<int16_t>(predictor);
+    }
+};
+
+int32_t ImaAdpcm::framesPerBlock(int32_t blockAlign, int32_t channelCount) {
+    int32_t headerBytes = kHeaderBytesPerChannel * channelCount;
+    int32_t groupBytes = kBytesPerChannelGroup * channelCount;
+    if (channelCount <= 0 || channelCount > kMaxChannels || blockAlign <= headerBytes ||
+        (blockAlign - headerBytes) % groupBytes != 0) {
+        return 0;
+    }
+    return (blockAlign - headerBytes) / groupBytes * kSamplesPerGroup + 1;
+}
+
+int32_t ImaAdpcm::decodeBlock(const uint8_t *block, size_t numBytes, int32_t channelCount,
+                              int16_t *output) {
+    auto headerBytes = static_cast<size_t>(kHeaderBytesPerChannel * channelCount);
+    auto groupBytes = static_cast<size_t>(kBytesPerChannelGroup * channelCount);
+    if (channelCount <= 0 || channelCount > kMaxChannels || numBytes < headerBytes) return 0;
+
+    // the header holds the first frame exactly
+    AdpcmChannel channels[kMaxChannels];
+    for (int32_t c = 0; c < channelCount; c++) {
+        const uint8_t *header = block + c * kHeaderBytesPerChannel;
+        channels[c].predictor = static_cast<int16_t>(header[0] | (header[1] << 8));
+        channels[c].stepIndex = std::min<int32_t>(header[2], kMaxStepIndex);
+        output[c] = static_cast<int16_t>(channels[c].predictor);
+    }
+
+    // then groups of 8 samples per channel, low nibble first
+    size_t numGroups = (numBytes - headerBytes) / groupBytes;
+    const uint8_t *group = block + headerBytes;
+    for (size_t g = 0; g < numGroups; g++) {
+        int16_t *frames = output + (1 + g * kSamplesPerGroup) * channelCount;
+        for (int32_t c = 0; c < channelCount; c++) {
+            const uint8_t *bytes = group + c * kBytesPerChannelGroup;
+            for (int32_t i = 0; i < kBytesPerChannelGroup; i++) {
+                frames[(2 * i) * channelCount + c] = channels[c].decode(bytes[i] & 0x0F);
+                frames[(2 * i + 1) * channelCount + c] = channels[c].decode(bytes[i] >> 4);
+            }
+        }
+        group += groupBytes;
+    }
+    return static_cast<int32_t>(1 + numGroups * kSamplesPerGroup);
+}
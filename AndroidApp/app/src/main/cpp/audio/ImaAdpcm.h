@@ -0,0 +1,49 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRUMMACHINE_IMAADPCM_H
+#define DRUMMACHINE_IMAADPCM_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Decoder for IMA ADPCM as stored in WAV files (WAVE_FORMAT_IMA_ADPCM): 4 bits per sample, in
+ * independent blocks which each start with the exact first sample of every channel. A quarter of the
+ * size of 16 bit PCM, and cheap enough to decode just ahead of playback.
+ */
+class ImaAdpcm {
+public:
+    /**
+     * @param blockAlign - bytes per block
+     * @return frames in a full block, 0 if blockAlign doesn't fit the channel count or there are
+     *         more than 8 channels
+     */
+    static int32_t framesPerBlock(int32_t blockAlign, int32_t channelCount);
+
+    /**
+     * Decode one block to interleaved int16_t
+     *
+     * @param block - the block, may be a short final block
+     * @param numBytes - size of the block
+     * @param output - room for framesPerBlock frames
+     * @return frames decoded
+     */
+    static int32_t decodeBlock(const uint8_t *block, size_t numBytes, int32_t channelCount,
+                               int16_t *output);
+};
+
+#endif //DRUMMACHINE_IMAADPCM_H
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/mman.h>
+#include <algorithm>
+#include <utils/logging.h>
+
+#include "MappedDataSource.h"
+
+/**
+ * Play a mapped WAV file as it is stored
+ *
+ * @param mapping - page aligned mapping of the file, owned by the source if one is returned
+ * @param audio - the audio found by WavDecoder::parse
+ * @return the sample, or nullptr if it needs converting or is too short to be worth streaming
+ */
+MappedDataSource* MappedDataSource::newFromMapping(void *mapping, size_t mappingLength,
+                                                   const uint8_t *audio, const WavInfo &info,
+                                                   const char *name, int32_t channelCount,
+                                                   int32_t sampleRate,
+                                                   std::shared_ptr<SamplePrefetcher> prefetcher) {
+    bool isPlayable = !info.isFloat && !info.isAdpcm && info.bitsPerSample == 16 &&
+                      info.channelCount == channelCount &&
+                      info.blockAlign == channelCount * static_cast<int32_t>(sizeof(int16_t)) &&
+                      info.sampleRate == sampleRate &&
+                      reinterpret_cast<uintptr_t>(audio) % alignof(int16_t) == 0;
+    if (!isPlayable || static_cast<int64_t>(info.numFrames) * 1000 <
+                       static_cast<int64_t>(sampleRate) * kMinMappedSampleMillis){
+        return nullptr;
+    }
+
+    LOGD("Mapped audio data source %s, %d Hz %d channels, frames: %d", name, info.sampleRate,
+         info.channelCount, info.numFrames);
+    return new MappedDataSource(mapping, mappingLength, reinterpret_cast<const int16_t*>(audio),
+                                info.numFrames, channelCount, sampleRate, std::move(prefetcher));
+}
+
+MappedDataSource::MappedDataSource(void *mapping, size_t mappingLength, const int16_t *data,
+                                   int32_t frames, int32_t channelCount, int32_t sampleRate,
+                                   std::shared_ptr<SamplePrefetcher> prefetcher)
+        : StreamedDataSource(std::move(prefetcher))
+        , mMapping(mapping)
+        , mMappingLength(mappingLength)
+        , mData(data)
+        , mTotalFrames(frames)
+        , mChannelCount(channelCount) {
+
+    // the head runs from the file header to the end of the attack
+    auto *mappingStart = static_cast<uint8_t*>(mapping);
+    mHeadLength = std::min(headLength(mappingStart, data, frames, channelCount, sampleRate),
+                           mappingLength);
+    lockPages(mappingStart, mHeadLength);
+    startStreaming(mappingStart + mHeadLength, mappingLength - mHeadLength, sampleRate);
+}
+
+MappedDataSource::~MappedDataSource() {
+    stopStreaming();
+    munmap(mMapping, mMappingLength);
+}
+
+void MappedDataSource::fillTail(size_t offset, size_t length) {
+    uint8_t *tail = static_cast<uint8_t*>(mMapping) + mHeadLength;
+    size_t tailLength = mMappingLength - mHeadLength;
+    if (offset + length < tailLength) {
+        // start reading the next chunk while we fault this one in
+        madvise(tail + offset + length, std::min(length, tailLength - offset - length),
+                MADV_WILLNEED);
+    }
+    touchPages(tail + offset, length);
+}
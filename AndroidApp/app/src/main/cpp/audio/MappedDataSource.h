@@ -0,0 +1,60 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRUMMACHINE_MAPPEDDATASOURCE_H
+#define DRUMMACHINE_MAPPEDDATASOURCE_H
+
+#include "StreamedDataSource.h"
+#include "WavDecoder.h"
+
+constexpr int kMinMappedSampleMillis = 1000; // shorter samples are decoded into memory
+
+/**
+ * A WAV file which is already in the engine's format (16 bit, right channel count and rate), played
+ * straight from a memory mapping of the file instead of being decoded into memory. The tail is
+ * paged in from the file when the sample is triggered.
+ */
+class MappedDataSource : public StreamedDataSource {
+
+public:
+    ~MappedDataSource() override;
+
+    int32_t getTotalFrames() const override { return mTotalFrames; } ;
+    int32_t getChannelCount() const override { return mChannelCount; } ;
+    const int16_t* getData() const override { return mData; };
+    size_t getResidentBytes() const override { return mHeadLength; };
+
+    static MappedDataSource* newFromMapping(void *mapping, size_t mappingLength,
+                                            const uint8_t *audio, const WavInfo &info,
+                                            const char *name, int32_t channelCount,
+                                            int32_t sampleRate,
+                                            std::shared_ptr<SamplePrefetcher> prefetcher);
+
+private:
+    MappedDataSource(void *mapping, size_t mappingLength, const int16_t *data, int32_t frames,
+                     int32_t channelCount, int32_t sampleRate,
+                     std::shared_ptr<SamplePrefetcher> prefetcher);
+    void fillTail(size_t offset, size_t length) override;
+
+    void * const mMapping;
+    const size_t mMappingLength;
+    const int16_t * const mData;
+    const int32_t mTotalFrames;
+    const int32_t mChannelCount;
+    size_t mHeadLength;
+};
+
+#endif //DRUMMACHINE_MAPPEDDATASOURCE_H
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRUMMACHINE_MIXKERNEL_H
+#define DRUMMACHINE_MIXKERNEL_H
+
+#include <cstdint>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MIX_KERNEL_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MIX_KERNEL_SSE2 1
+#endif
+
+/**
+ * Name of the mix kernel selected at compile time, handy for logging and benchmarks
+ */
+#if defined(MIX_KERNEL_NEON)
+constexpr const char *kMixKernelName = "neon";
+#elif defined(MIX_KERNEL_SSE2)
+constexpr const char *kMixKernelName = "sse2";
+#else
+constexpr const char *kMixKernelName = "scalar";
+#endif
+
+constexpr float kInt16ToFloat = 1.0f / 32768.0f;
+
+// The soft limiter is transparent below this level and bends smoothly towards full scale above it
+constexpr float kLimiterThreshold = 0.8f;
+
+/**
+ * Convert numSamples int16_t samples of source to float and add them onto the mix bus
+ *
+ * @param mixBus - float buffer to accumulate into, full scale is [-1.0, 1.0]
+ * @param source - buffer to be mixed
+ * @param numSamples - number of samples (not frames) in both buffers
+ */
+inline void mixToBus(float *mixBus, const int16_t *source, int32_t numSamples) {
+    int32_t i = 0;
+
+#if defined(MIX_KERNEL_NEON)
+    for (; i + 8 <= numSamples; i += 8) {
+        int16x8_t s = vld1q_s16(source + i);
+        float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+        float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+        vst1q_f32(mixBus + i, vmlaq_n_f32(vld1q_f32(mixBus + i), lo, kInt16ToFloat));
+        vst1q_f32(mixBus + i + 4, vmlaq_n_f32(vld1q_f32(mixBus + i + 4), hi, kInt16ToFloat));
+    }
+#elif defined(MIX_KERNEL_SSE2)
+    const __m128 scale = _mm_set1_ps(kInt16ToFloat);
+    for (; i + 8 <= numSamples; i += 8) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        // sign-extend to 32 bit by placing each sample in the upper half and shifting it back down
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+        _mm_storeu_ps(mixBus + i, _mm_add_ps(_mm_loadu_ps(mixBus + i), _mm_mul_ps(lo, scale)));
+        _mm_storeu_ps(mixBus + i + 4, _mm_add_ps(_mm_loadu_ps(mixBus + i + 4), _mm_mul_ps(hi, scale)));
+    }
+#endif
+
+    // scalar fallback, also handles the remainder of the vector loops
+    for (; i < numSamples; ++i) {
+        mixBus[i] += source[i] * kInt16ToFloat;
+    }
+}
+
+/**
+ * Convert interleaved stereo int16_t samples to float, apply a gain per channel and add them onto
+ * the mix bus. The gains already include the int16_t to float scaling, see stereoGain().
+ *
+ * @param mixBus - float buffer to accumulate into, full scale is [-1.0, 1.0]
+ * @param source - stereo buffer to be mixed, starting on a left sample
+ * @param numSamples - number of samples (not frames) in both buffers
+ * @param gainLeft - gain of the even samples
+ * @param gainRight - gain of the odd samples
+ */
+inline void mixToBus(float *mixBus, const int16_t *source, int32_t numSamples,
+                     float gainLeft, float gainRight) {
+    int32_t i = 0;
+
+#if defined(MIX_KERNEL_NEON)
+    const float gainPattern[4] = { gainLeft, gainRight, gainLeft, gainRight };
+    const float32x4_t gains = vld1q_f32(gainPattern);
+    for (; i + 8 <= numSamples; i += 8) {
+        int16x8_t s = vld1q_s16(source + i);
+        float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+        float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+        vst1q_f32(mixBus + i, vmlaq_f32(vld1q_f32(mixBus + i), lo, gains));
+        vst1q_f32(mixBus + i + 4, vmlaq_f32(vld1q_f32(mixBus + i + 4), hi, gains));
+    }
+#elif defined(MIX_KERNEL_SSE2)
+    const __m128 gains = _mm_setr_ps(gainLeft, gainRight, gainLeft, gainRight);
+    for (; i + 8 <= numSamples; i += 8) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+        _mm_storeu_ps(mixBus + i, _mm_add_ps(_mm_loadu_ps(mixBus + i), _mm_mul_ps(lo, gains)));
+        _mm_storeu_ps(mixBus + i + 4, _mm_add_ps(_mm_loadu_ps(mixBus + i + 4), _mm_mul_ps(hi, gains)));
+    }
+#endif
+
+    // scalar fallback, also handles the remainder of the vector loops. The vector loops step by a
+    // multiple of 2, so i is always even here.
+    for (; i + 1 < numSamples; i += 2) {
+        mixBus[i] += source[i] * gainLeft;
+        mixBus[i + 1] += source[i + 1] * gainRight;
+    }
+    if (i < numSamples) {
+        mixBus[i] += source[i] * gainLeft;
+    }
+}
+
+/**
+ * Lookahead-free soft limiter. Samples below kLimiterThreshold pass through untouched, louder ones
+ * are compressed with x / (1 + x) so the output approaches but never exceeds full scale. The curve
+ * has the same slope as the linear part at the threshold, so there is no audible kink.
+ */
+inline float softLimit(float sample) {
+    float magnitude = sample < 0 ? -sample : sample;
+    if (magnitude <= kLimiterThreshold) return sample;
+
+    constexpr float kHeadroom = 1.0f - kLimiterThreshold;
+    float over = (magnitude - kLimiterThreshold) / kHeadroom;
+    float limited = kLimiterThreshold + kHeadroom * over / (1.0f + over);
+    return sample < 0 ? -limited : limited;
+}
+
+/**
+ * Run the mix bus through the limiter into a float output buffer
+ */
+inline void limitToFloat(float *target, const float *mixBus, int32_t numSamples) {
+    for (int32_t i = 0; i < numSamples; ++i) {
+        target[i] = softLimit(mixBus[i]);
+    }
+}
+
+/**
+ * Run the mix bus through the limiter into an int16_t output buffer
+ */
+inline void limitToI16(int16_t *target, const float *mixBus, int32_t numSamples) {
+    for (int32_t i = 0; i < numSamples; ++i) {
+        // scale by 32768 so a single unclipped track passes through bit-exact
+        float scaled = softLimit(mixBus[i]) * 32768.0f;
+        target[i] = scaled >= INT16_MAX ? INT16_MAX : static_cast<int16_t>(scaled);
+    }
+}
+
+#endif //DRUMMACHINE_MIXKERNEL_H
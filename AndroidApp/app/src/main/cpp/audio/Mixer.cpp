@@ -15,26 +15,93 @@
  */
 
 #include "Mixer.h"
+#include "MixKernel.h"
 
 void Mixer::renderAudio(int16_t *audioData, int32_t numFrames) {
+    mixTracks(numFrames);
+    limitToI16(audioData, mMixBus.data(), numFrames * kChannelCount);
+}
+
+void Mixer::renderAudio(float *audioData, int32_t numFrames) {
+    mixTracks(numFrames);
+    limitToFloat(audioData, mMixBus.data(), numFrames * kChannelCount);
+}
 
-    // Zero out the incoming container array
+/**
+ * Sum all sounding tracks into the float mix bus. Converting to the output format happens once
+ * afterwards, so loud overlapping hits cannot overflow the intermediate sum.
+ */
+void Mixer::mixTracks(int32_t numFrames) {
+
+    // Zero out the mix bus
     for (int j = 0; j < numFrames * kChannelCount; ++j) {
-        audioData[j] = 0;
+        mMixBus[j] = 0;
     }
 
-    for (int i = 0; i < mNextFreeTrackIndex; ++i) {
-        mTracks[i]->renderAudio(mixingBuffer.data(), numFrames);
+    updateActiveTracks();
+
+    int i = 0;
+    while (i < mNumActiveTracks) {
+        uint8_t trackIdx = mActiveTracks[i];
+        mTracks[trackIdx]->mixAudio(mMixBus.data(), numFrames);
 
-        for (int j = 0; j < numFrames * kChannelCount; ++j) {
-            audioData[j] += mixingBuffer[j];
+        if (mTracks[trackIdx]->isPlaying()) {
+            ++i;
+        } else {
+            // the track has finished, move the last active track into its slot
+            mActiveTracks[i] = mActiveTracks[--mNumActiveTracks];
+            mActiveTrackMask &= ~(uint64_t{1} << trackIdx);
         }
     }
+
+    for (auto &renderer : mRenderers) {
+        if (!renderer->isPlaying()) continue;
+        renderer->renderAudio(mixingBuffer.data(), numFrames);
+        mixToBus(mMixBus.data(), mixingBuffer.data(), numFrames * kChannelCount);
+    }
 }
 
-void Mixer::addTrack(std::shared_ptr<RenderableAudio> renderer){
-    mTracks[mNextFreeTrackIndex++] = renderer;
+/**
+ * Move tracks activated since the last render into the active track list
+ */
+void Mixer::updateActiveTracks() {
+    uint64_t pending = mPendingTracks.exchange(0) & ~mActiveTrackMask;
+    while (pending != 0) {
+        auto trackIdx = static_cast<uint8_t>(__builtin_ctzll(pending));
+        pending &= pending - 1;
+        if (mTracks[trackIdx] == nullptr) continue;
+
+        mActiveTracks[mNumActiveTracks++] = trackIdx;
+        mActiveTrackMask |= uint64_t{1} << trackIdx;
+    }
+}
+
+/**
+ * Mark a track as sounding so that it gets mixed from the next render onwards. Idle tracks are
+ * not touched by the mixer at all. Safe to call from any thread.
+ *
+ * @param trackIdx - index of the track, in the order the tracks were added
+ */
+void Mixer::activateTrack(uint8_t trackIdx) {
+    mPendingTracks.fetch_or(uint64_t{1} << trackIdx);
+}
+
+/**
+ * Add a sample player as the next track, see activateTrack
+ */
+void Mixer::addTrack(std::shared_ptr<Player> player){
+    uint8_t trackIdx = mNextFreeTrackIndex++;
+    mTracks[trackIdx] = player;
+    if (player->isPlaying()) activateTrack(trackIdx);
     // If we've reached our track limit then overwrite the first track
     if (mNextFreeTrackIndex >= kMaxTracks)
         mNextFreeTrackIndex = 0;
+};
+
+/**
+ * Add a custom renderer. These are rendered whenever they report isPlaying() and don't take a
+ * track index. Must not be called while audio is being rendered.
+ */
+void Mixer::addTrack(std::shared_ptr<RenderableAudio> renderer){
+    mRenderers.push_back(renderer);
 };
\ No newline at end of file
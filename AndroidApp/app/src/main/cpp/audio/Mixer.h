@@ -18,23 +18,45 @@
 #define RHYTHMGAME_MIXER_H
 
 
+#include <atomic>
+#include <vector>
+
 #include "Player.h"
 #include "RenderableAudio.h"
 
 constexpr int32_t kBufferSize = 192*10; // Temporary buffer is used for mixing
-constexpr uint8_t kMaxTracks = 10;
+constexpr uint8_t kMaxTracks = 64; // Bounded by the width of the active track mask
 constexpr int32_t kChannelCount = 2;
+constexpr int32_t kMaxFramesPerRender = kBufferSize / kChannelCount; // Largest block renderAudio can mix at once
 
 class Mixer : public RenderableAudio {
 
 public:
+    void addTrack(std::shared_ptr<Player> player);
     void addTrack(std::shared_ptr<RenderableAudio> renderer);
+    void activateTrack(uint8_t trackIdx);
     void renderAudio(int16_t *audioData, int32_t numFrames);
+    void renderAudio(float *audioData, int32_t numFrames);
 
 private:
+    void mixTracks(int32_t numFrames);
+    void updateActiveTracks();
+
     std::array<int16_t, kBufferSize> mixingBuffer;
-    std::shared_ptr<RenderableAudio> mTracks[kMaxTracks]; // TODO: this might be better as a linked list for easy track removal
+    std::array<float, kBufferSize> mMixBus; // Tracks are summed here with headroom, then limited
+
+    // Sample players are stored by their concrete type so that mixing them needs no virtual call
+    // and no intermediate buffer. Any other renderer goes through the generic, slower path.
+    std::shared_ptr<Player> mTracks[kMaxTracks];
     uint8_t mNextFreeTrackIndex = 0;
+    std::vector<std::shared_ptr<RenderableAudio>> mRenderers;
+
+    // Only the tracks in mActiveTracks are rendered. Activation requests may come from any thread
+    // and are collected in mPendingTracks until the next render picks them up.
+    std::atomic<uint64_t> mPendingTracks { 0 };
+    uint64_t mActiveTrackMask = 0;
+    uint8_t mActiveTracks[kMaxTracks];
+    uint8_t mNumActiveTracks = 0;
 };
 
 #endif //RHYTHMGAME_MIXER_H
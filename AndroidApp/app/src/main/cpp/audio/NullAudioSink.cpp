@@ -0,0 +1,99 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <chrono>
+#include <utils/logging.h>
+
+#include "NullAudioSink.h"
+
+NullAudioSink::NullAudioSink(bool isRealtime, std::string wavPath, int32_t nativeSampleRate,
+                             int32_t framesPerBlock)
+        : mIsRealtime(isRealtime)
+        , mWavPath(std::move(wavPath))
+        , mNativeSampleRate(nativeSampleRate)
+        , mFramesPerBlock(framesPerBlock) {
+}
+
+/**
+ * Start the render thread
+ *
+ * @return false if already running or the WAV file can't be created
+ */
+bool NullAudioSink::start(AudioSinkCallback *callback, int32_t sampleRate, int32_t channelCount) {
+    if (mIsRunning) {
+        LOGE("Null audio sink already started");
+        return false;
+    }
+    if (!mWavPath.empty() && !mWavWriter.open(mWavPath.c_str(), sampleRate, channelCount)) {
+        return false;
+    }
+    mCallback = callback;
+    mSampleRate = sampleRate;
+    // the WAV file is 16 bit, otherwise the mixer's float output is exercised like on a device
+    mFloatBlock.assign(static_cast<size_t>(mFramesPerBlock * channelCount), 0.0f);
+    mInt16Block.assign(static_cast<size_t>(mFramesPerBlock * channelCount), 0);
+    mFramesRendered = 0;
+    mXRunCount = 0;
+    mIsStopRequested = false;
+    mIsRunning = true;
+    mThread = std::thread(&NullAudioSink::run, this);
+    return true;
+}
+
+/**
+ * Stop the render thread and finish the WAV file, if any
+ */
+void NullAudioSink::stop() {
+    if (!mIsRunning) return;
+    mIsStopRequested = true;
+    mThread.join();
+    if (!mWavPath.empty() && !mWavWriter.close()) {
+        LOGE("Failed to write %s", mWavPath.c_str());
+    }
+    mIsRunning = false;
+}
+
+/**
+ * Render thread: pull a block at a time until stopped. When paced, each block is due when the
+ * previous one would have finished playing, measured from the start so that sleep jitter doesn't
+ * add up. A block which is rendered after it was due counts as an underrun, and the schedule
+ * restarts from there like a device stream would.
+ */
+void NullAudioSink::run() {
+    const bool isWritingWav = !mWavPath.empty();
+    auto startTime = std::chrono::steady_clock::now();
+    int64_t framesRendered = 0;
+
+    while (!mIsStopRequested) {
+        if (isWritingWav) {
+            mCallback->onRenderAudio(mInt16Block.data(), false, mFramesPerBlock);
+            mWavWriter.write(mInt16Block.data(), mFramesPerBlock);
+        } else {
+            mCallback->onRenderAudio(mFloatBlock.data(), true, mFramesPerBlock);
+        }
+        framesRendered += mFramesPerBlock;
+        mFramesRendered = framesRendered;
+
+        if (mIsRealtime) {
+            auto due = startTime + std::chrono::microseconds(framesRendered * 1000000 / mSampleRate);
+            auto now = std::chrono::steady_clock::now();
+            if (now > due) {
+                mXRunCount++;
+                startTime = now - std::chrono::microseconds(framesRendered * 1000000 / mSampleRate);
+            }
+            std::this_thread::sleep_until(due);
+        }
+    }
+}
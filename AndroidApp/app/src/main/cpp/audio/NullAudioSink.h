@@ -0,0 +1,76 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DRUMMACHINE_NULLAUDIOSINK_H
+#define DRUMMACHINE_NULLAUDIOSINK_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioSink.h"
+#include "DrumMachineConstants.h"
+#include "WavWriter.h"
+
+constexpr int32_t kNullSinkFramesPerBlock = 192; // a typical burst size at 48kHz
+
+/**
+ * An audio sink without a device, for running the engine on the host. A thread pulls audio in
+ * blocks, either paced to the sample rate like a device stream or as fast as possible, and
+ * optionally writes it to a WAV file.
+ */
+class NullAudioSink : public AudioSink {
+public:
+    /**
+     * @param isRealtime - pace the callbacks to the sample rate, or run them back to back
+     * @param wavPath - file to record the output to, or empty to discard it
+     * @param nativeSampleRate - rate the sink pretends the device runs at
+     */
+    explicit NullAudioSink(bool isRealtime = true, std::string wavPath = "",
+                           int32_t nativeSampleRate = kDefaultSampleRateHz,
+                           int32_t framesPerBlock = kNullSinkFramesPerBlock);
+    ~NullAudioSink() override { stop(); }
+
+    bool start(AudioSinkCallback *callback, int32_t sampleRate, int32_t channelCount) override;
+    void stop() override;
+    bool isRunning() const override { return mIsRunning; }
+    int32_t getXRunCount() const override { return mXRunCount; }
+    int32_t getNativeSampleRate() override { return mNativeSampleRate; }
+
+    int64_t getFramesRendered() const { return mFramesRendered; }
+
+private:
+    void run();
+
+    const bool mIsRealtime;
+    const std::string mWavPath;
+    const int32_t mNativeSampleRate;
+    const int32_t mFramesPerBlock;
+
+    AudioSinkCallback *mCallback = nullptr;
+    int32_t mSampleRate = 0;
+    WavWriter mWavWriter;
+    std::vector<float> mFloatBlock;
+    std::vector<int16_t> mInt16Block;
+
+    std::thread mThread;
+    std::atomic<bool> mIsRunning { false };
+    std::atomic<bool> mIsStopRequested { false };
+    std::atomic<int64_t> mFramesRendered { 0 };
+    std::atomic<int32_t> mXRunCount { 0 };
+};
+
+#endif //DRUMMACHINE_NULLAUDIOSINK_H
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <utils/logging.h>
+
+#include "OboeAudioSink.h"
+#include "DrumMachineConstants.h"
+
+using namespace oboe;
+
+/**
+ * Find the rate of the low latency output path by opening a stream without asking for a rate.
+ * Opening the real stream at this rate keeps Android's resampler, and its latency, out of the way.
+ *
+ * @return the device's rate, or kDefaultSampleRateHz if no stream could be opened
+ */
+int32_t OboeAudioSink::getNativeSampleRate() {
+    if (mNativeSampleRate != 0) return mNativeSampleRate;
+
+    AudioStreamBuilder builder;
+    builder.setChannelCount(ChannelCount::Stereo);
+    builder.setPerformanceMode(PerformanceMode::LowLatency);
+    builder.setSharingMode(SharingMode::Exclusive);
+
+    AudioStream *stream = nullptr;
+    Result result = builder.openStream(&stream);
+    if (result != Result::OK){
+        LOGW("Failed to probe the native sample rate, using %d Hz. Error: %s", kDefaultSampleRateHz,
+             convertToText(result));
+        return kDefaultSampleRateHz;
+    }
+    mNativeSampleRate = stream->getSampleRate();
+    stream->close();
+    delete stream;
+    LOGD("Native sample rate %d Hz", mNativeSampleRate);
+    return mNativeSampleRate;
+}
+
+/**
+ * Open and start the audio stream
+ *
+ * @return false if the stream could not be opened or started
+ */
+bool OboeAudioSink::start(AudioSinkCallback *callback, int32_t sampleRate, int32_t channelCount) {
+    // Note: must call stop() first before calling start() for a second time
+    mCallback = callback;
+
+    // Create a builder
+    AudioStreamBuilder builder;
+    builder.setFormat(AudioFormat::Float);
+    builder.setChannelCount(channelCount);
+    builder.setSampleRate(sampleRate);
+    builder.setCallback(this);
+    builder.setPerformanceMode(PerformanceMode::LowLatency);
+    builder.setSharingMode(SharingMode::Exclusive);
+
+    // The mixer works in float internally, so a float stream avoids the final conversion. Fall back
+    // to 16 bit output on devices which can't open one.
+    Result result = builder.openStream(&mAudioStream);
+    if (result != Result::OK){
+        LOGW("Failed to open float stream, falling back to I16. Error: %s", convertToText(result));
+        builder.setFormat(AudioFormat::I16);
+        result = builder.openStream(&mAudioStream);
+    }
+    if (result != Result::OK){
+        LOGE("Failed to open stream. Error: %s", convertToText(result));
+        mAudioStream = nullptr;
+        return false;
+    }
+
+    if (mAudioStream->getSampleRate() != sampleRate){
+        LOGW("Stream opened at %d Hz instead of %d Hz", mAudioStream->getSampleRate(), sampleRate);
+    }
+
+    // Reduce stream latency by setting the buffer size to a multiple of the burst size
+    auto setBufferSizeResult = mAudioStream->setBufferSizeInFrames(
+            mAudioStream->getFramesPerBurst() * kBufferSizeInBursts);
+    if (setBufferSizeResult != Result::OK){
+        LOGW("Failed to set buffer size. Error: %s", convertToText(setBufferSizeResult.error()));
+    }
+
+    // Start mixer
+    result = mAudioStream->requestStart();
+    if (result != Result::OK){
+        LOGE("Failed to start stream. Error: %s", convertToText(result));
+        stop();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Stop playback and close the audio stream
+ */
+void OboeAudioSink::stop() {
+    if (mAudioStream != nullptr){
+        mAudioStream->close();
+        delete mAudioStream;
+        mAudioStream = nullptr;
+    }
+}
+
+/**
+ * Underruns reported by the stream, 0 where the audio API doesn't count them (OpenSL ES)
+ */
+int32_t OboeAudioSink::getXRunCount() const {
+    auto xRunCount = mAudioStream->getXRunCount();
+    return xRunCount ? xRunCount.value() : 0;
+}
+
+/**
+ * Pass the stream's buffer on to the engine, in whichever format the stream was opened with
+ */
+DataCallbackResult OboeAudioSink::onAudioReady(AudioStream *oboeStream, void *audioData, int32_t numFrames) {
+    mCallback->onRenderAudio(audioData, oboeStream->getFormat() == AudioFormat::Float, numFrames);
+    return DataCallbackResult::Continue;
+}
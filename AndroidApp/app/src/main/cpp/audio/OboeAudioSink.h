@@ -0,0 +1,47 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DRUMMACHINE_OBOEAUDIOSINK_H
+#define DRUMMACHINE_OBOEAUDIOSINK_H
+
+#include <oboe/Oboe.h>
+
+#include "AudioSink.h"
+
+/**
+ * Plays the engine through a low latency Oboe stream
+ */
+class OboeAudioSink : public AudioSink, public oboe::AudioStreamCallback {
+public:
+    OboeAudioSink() = default;
+    ~OboeAudioSink() override { stop(); }
+
+    bool start(AudioSinkCallback *callback, int32_t sampleRate, int32_t channelCount) override;
+    void stop() override;
+    bool isRunning() const override { return mAudioStream != nullptr; }
+    int32_t getXRunCount() const override;
+    int32_t getNativeSampleRate() override;
+
+    // Inherited from oboe::AudioStreamCallback
+    oboe::DataCallbackResult
+    onAudioReady(oboe::AudioStream *oboeStream, void *audioData, int32_t numFrames) override;
+
+private:
+    oboe::AudioStream *mAudioStream{nullptr};
+    AudioSinkCallback *mCallback = nullptr;
+    int32_t mNativeSampleRate = 0; // 0 until probed
+};
+
+#endif //DRUMMACHINE_OBOEAUDIOSINK_H
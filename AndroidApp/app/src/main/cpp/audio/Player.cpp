@@ -14,46 +14,206 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include "Player.h"
+#include "MixKernel.h"
 #include "utils/logging.h"
 
+Player::Player(std::shared_ptr<DataSource> source, int32_t maxVoices,
+               VoiceStealPolicy stealPolicy)
+        : mStealPolicy(stealPolicy)
+        , mSource(source)
+        , mVoices(static_cast<size_t>(std::max(maxVoices, 1))) {
+    setStealPolicy(stealPolicy);
+}
+
+/**
+ * Choose which voice a trigger cuts once all of them are sounding. The first time Quietest is
+ * chosen the source's envelope is fetched, so don't call this from the audio thread.
+ */
+void Player::setStealPolicy(VoiceStealPolicy stealPolicy) {
+    if (stealPolicy == VoiceStealPolicy::Quietest && mEnvelope.empty()) {
+        // a coarse peak envelope finds the quietest voice with a single lookup, it is published to
+        // the audio thread by storing the policy below
+        mEnvelope = mSource->getEnvelope();
+    }
+    mStealPolicy = stealPolicy;
+}
+
+/**
+ * Start (true) a new hit of the sample at full velocity, or stop (false) all hits which are
+ * currently sounding or started before the stop. Takes effect at the start of the next renderAudio
+ * call, see trigger for which threads may call this.
+ */
+void Player::setPlaying(bool isPlaying) {
+    if (isPlaying) {
+        trigger();
+    } else if (!mPendingTriggers.push(kStop)) {
+        mStopPending = true;
+    }
+}
+
+/**
+ * Start a new hit of the sample at the start of the next renderAudio call. Every hit which arrives
+ * before then gets a voice of its own, up to kMaxPendingTriggers. Hits must come from one thread at
+ * a time, the DrumMachine only triggers from the audio thread.
+ *
+ * @param velocity - loudness of the hit, 0 to kMaxVelocity
+ * @param pan - 0 for hard left, kCenterPan, up to kNumPanPositions - 1 for hard right
+ */
+void Player::trigger(uint8_t velocity, uint8_t pan) {
+    mPendingTriggers.push((static_cast<uint32_t>(velocity) << 8) | pan);
+}
+
 void Player::renderAudio(int16_t *targetData, int32_t numFrames){
+    renderSilence(targetData, numFrames * mSource->getChannelCount());
+    renderVoices(numFrames, [targetData](const Voice &voice, int32_t targetOffset,
+                                         const int16_t *source, int32_t numSamples) {
+        // the offsets are whole frames, so even samples are always on the left
+        const float gains[2] = { voice.gain.left, voice.gain.right };
+        int16_t *target = targetData + targetOffset;
+        for (int32_t i = 0; i < numSamples; ++i) {
+            int32_t sum = target[i] + static_cast<int32_t>(source[i] * gains[i & 1]);
+            target[i] = static_cast<int16_t>(std::max<int32_t>(INT16_MIN, std::min<int32_t>(INT16_MAX, sum)));
+        }
+    });
+}
 
-    const int32_t channelCount = mSource->getChannelCount();
+/**
+ * Add all sounding voices onto a float mix bus. This is what the Mixer calls for sample tracks, it
+ * skips the intermediate int16_t buffer and the mixing loop vectorizes.
+ */
+void Player::mixAudio(float *mixBus, int32_t numFrames) {
+    renderVoices(numFrames, [mixBus](const Voice &voice, int32_t targetOffset,
+                                     const int16_t *source, int32_t numSamples) {
+        mixToBus(mixBus + targetOffset, source, numSamples,
+                 voice.gain.left * kInt16ToFloat, voice.gain.right * kInt16ToFloat);
+    });
+}
 
-    if (mIsPlaying){
+/**
+ * Apply pending triggers, then hand every voice's contiguous spans of source data to mixSpan,
+ * dropping the voices that reach the end of the sample.
+ *
+ * @param mixSpan - called as mixSpan(voice, targetSampleOffset, sourceSamples, numSamples)
+ */
+template <typename MixSpan>
+void Player::renderVoices(int32_t numFrames, MixSpan mixSpan) {
 
-        int32_t framesToRenderFromData = numFrames;
-        int32_t totalSourceFrames = mSource->getTotalFrames();
-        const int16_t *data = mSource->getData();
+    uint32_t trigger;
+    if (mStopPending.exchange(false)) {
+        mNumActiveVoices = 0;
+        while (mPendingTriggers.pop(trigger)) {}
+    }
+    while (mPendingTriggers.pop(trigger)) {
+        if (trigger == kStop) {
+            mNumActiveVoices = 0;
+        } else {
+            startVoice(trigger);
+        }
+    }
 
-        // Check whether we're about to reach the end of the recording
-        if (!mIsLooping && mReadFrameIndex + numFrames >= totalSourceFrames){
-            framesToRenderFromData = totalSourceFrames - mReadFrameIndex;
-            mIsPlaying = false;
+    int32_t numActiveVoices = mNumActiveVoices;
+    int32_t numRemainingVoices = 0;
+    for (int32_t v = 0; v < numActiveVoices; ++v) {
+        Voice &voice = mVoices[v];
+        if (renderVoice(voice, numFrames, mixSpan)) {
+            // keep the voices ordered from oldest to newest
+            mVoices[numRemainingVoices++] = voice;
         }
+    }
+    mNumActiveVoices = numRemainingVoices;
+}
 
-        for (int i = 0; i < framesToRenderFromData; ++i) {
-            for (int j = 0; j < channelCount; ++j) {
-                targetData[(i*channelCount)+j] = data[(mReadFrameIndex*channelCount)+j];
-            }
+/**
+ * Render one voice of the sample
+ *
+ * @return false if the voice reached the end of the sample and has stopped
+ */
+template <typename MixSpan>
+bool Player::renderVoice(Voice &voice, int32_t numFrames, MixSpan mixSpan) {
+
+    const int32_t channelCount = mSource->getChannelCount();
+    const int32_t totalSourceFrames = mSource->getTotalFrames();
+    const int32_t readableFrames = mSource->getReadableFrames();
+    const int16_t *data = mSource->getData();
+    if (totalSourceFrames == 0) return false;
 
-            // Increment and handle wraparound
-            if (++mReadFrameIndex >= totalSourceFrames) mReadFrameIndex = 0;
+    int32_t framesRendered = 0;
+    while (framesRendered < numFrames) {
+        // Render up to the end of the block or the end of the recording
+        int32_t framesToRender = std::min(numFrames - framesRendered,
+                                          totalSourceFrames - voice.readFrameIndex);
+        // a streamed sample which isn't filled in this far yet is silent rather than read
+        int32_t framesToMix = std::max(0, std::min(framesToRender,
+                                                   readableFrames - voice.readFrameIndex));
+        if (framesToMix > 0) {
+            mixSpan(voice, framesRendered * channelCount,
+                    data + (voice.readFrameIndex * channelCount), framesToMix * channelCount);
         }
+        framesRendered += framesToRender;
 
-        if (framesToRenderFromData < numFrames){
-            // fill the rest of the buffer with silence
-            renderSilence(&targetData[framesToRenderFromData], numFrames * channelCount);
+        // Handle the end of the recording and wraparound
+        voice.readFrameIndex += framesToRender;
+        if (voice.readFrameIndex >= totalSourceFrames) {
+            if (!mIsLooping) return false;
+            voice.readFrameIndex = 0;
+            mSource->prefetch();
         }
+    }
+    return true;
+}
 
+/**
+ * Start a new voice at the beginning of the sample, stealing one if the pool is full
+ *
+ * @param trigger - velocity and pan packed by trigger()
+ */
+void Player::startVoice(uint32_t trigger) {
+    int32_t numActiveVoices = mNumActiveVoices;
+    if (numActiveVoices == static_cast<int32_t>(mVoices.size())) {
+        // drop the stolen voice while keeping the others in order
+        int32_t stolen = findVoiceToSteal();
+        for (int32_t v = stolen; v < numActiveVoices - 1; ++v) {
+            mVoices[v] = mVoices[v + 1];
+        }
+        --numActiveVoices;
+    }
+    auto velocity = static_cast<uint8_t>(trigger >> 8);
+    auto pan = static_cast<uint8_t>(trigger);
+    Voice &voice = mVoices[numActiveVoices];
+    voice.readFrameIndex = 0;
+    mSource->prefetch();
+    if (mSource->getChannelCount() == 2) {
+        voice.gain = stereoGain(velocity, pan);
     } else {
-        renderSilence(targetData, numFrames * channelCount);
+        // nowhere to pan a mono sample to
+        float gain = velocityGain(velocity);
+        voice.gain = { gain, gain };
+    }
+    mNumActiveVoices = numActiveVoices + 1;
+}
+
+int32_t Player::findVoiceToSteal() const {
+    if (mStealPolicy == VoiceStealPolicy::Oldest) return 0;
+
+    int32_t quietest = 0;
+    float quietestLevel = 0;
+    for (int32_t v = 0; v < mNumActiveVoices; ++v) {
+        const Voice &voice = mVoices[v];
+        float level = mEnvelope[voice.readFrameIndex / kEnvelopeBlockFrames] *
+                      std::max(voice.gain.left, voice.gain.right);
+        if (v == 0 || level < quietestLevel) {
+            quietest = v;
+            quietestLevel = level;
+        }
     }
+    return quietest;
 }
 
 void Player::renderSilence(int16_t *start, int32_t numSamples){
     for (int i = 0; i < numSamples; ++i) {
         start[i] = 0;
     }
-}
\ No newline at end of file
+}
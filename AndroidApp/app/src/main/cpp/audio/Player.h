@@ -23,13 +23,26 @@
 #include <chrono>
 #include <memory>
 #include <atomic>
-
-#include <android/asset_manager.h>
+#include <vector>
 
 #include "RenderableAudio.h"
 #include "DataSource.h"
+#include "GainTables.h"
+#include "utils/LockFreeQueue.h"
+
+constexpr int32_t kDefaultMaxVoices = 4;
+constexpr int32_t kMaxVoices = 16; // per Player, every voice is mixed on each render
+constexpr uint32_t kMaxPendingTriggers = 16; // hits of one Player waiting for the next render
+
+/**
+ * Which voice to cut when a Player is triggered while all of its voices are sounding
+ */
+enum class VoiceStealPolicy {
+    Oldest,     // the voice which started first
+    Quietest,   // the voice whose current position in the sample is the least loud
+};
 
-class Player : public RenderableAudio{
+class Player final : public RenderableAudio{
 
 public:
     /**
@@ -37,23 +50,49 @@ public:
      * For example, you could play two identical sounds concurrently by creating 2 Players with the
      * same data source.
      *
+     * Each trigger starts a new voice so that fast retriggers let the previous hit ring out. All
+     * voices are allocated here, never on the audio thread.
+     *
      * @param source
+     * @param maxVoices - number of hits of this sample which can sound at the same time
+     * @param stealPolicy - voice to reuse once all maxVoices are sounding
      */
-    Player(std::shared_ptr<DataSource> source)
-        : mSource(source)
-    {};
+    Player(std::shared_ptr<DataSource> source, int32_t maxVoices = kDefaultMaxVoices,
+           VoiceStealPolicy stealPolicy = VoiceStealPolicy::Oldest);
 
     void renderAudio(int16_t *targetData, int32_t numFrames);
-    void resetPlayHead() { mReadFrameIndex = 0; };
-    void setPlaying(bool isPlaying) { mIsPlaying = isPlaying; resetPlayHead(); };
+    void mixAudio(float *mixBus, int32_t numFrames);
+    bool isPlaying() const override { return mNumActiveVoices > 0 || mPendingTriggers.size() > 0; };
+    void setPlaying(bool isPlaying);
+    void trigger(uint8_t velocity = kMaxVelocity, uint8_t pan = kCenterPan);
     void setLooping(bool isLooping) { mIsLooping = isLooping; };
+    void setStealPolicy(VoiceStealPolicy stealPolicy);
+    void setSourcePinned(bool isPinned) { mSource->setPinned(isPinned); };
 
 private:
-    int32_t mReadFrameIndex = 0;
-    std::atomic<bool> mIsPlaying { false };
+    struct Voice {
+        int32_t readFrameIndex;
+        StereoGain gain;
+    };
+
+    // Triggers wait here until the next renderAudio, which gives each of them a voice. A pending
+    // trigger packs its velocity and pan together, a stop is queued in order with them as kStop.
+    static constexpr uint32_t kStop = 1u << 16;
+    LockFreeQueue<uint32_t, kMaxPendingTriggers> mPendingTriggers;
+    std::atomic<bool> mStopPending { false }; // a stop which didn't fit into mPendingTriggers
     std::atomic<bool> mIsLooping { false };
+    std::atomic<VoiceStealPolicy> mStealPolicy;
     std::shared_ptr<DataSource> mSource;
 
+    // Active voices are kept at the front of mVoices, ordered from oldest to newest
+    std::vector<Voice> mVoices;
+    std::atomic<int32_t> mNumActiveVoices { 0 };
+    std::vector<int16_t> mEnvelope; // Peak level per kEnvelopeBlockFrames frames, only for Quietest
+
+    void startVoice(uint32_t trigger);
+    int32_t findVoiceToSteal() const;
+    template <typename MixSpan> void renderVoices(int32_t numFrames, MixSpan mixSpan);
+    template <typename MixSpan> bool renderVoice(Voice &voice, int32_t numFrames, MixSpan mixSpan);
     void renderSilence(int16_t*, int32_t);
 };
 
@@ -25,6 +25,12 @@ class RenderableAudio {
 public:
     virtual ~RenderableAudio() = default;
     virtual void renderAudio(int16_t *audioData, int32_t numFrames) = 0;
+
+    /**
+     * Whether the next renderAudio call would produce any sound. Mixers use this to skip idle
+     * tracks, so renderers which can fall silent should override it.
+     */
+    virtual bool isPlaying() const { return true; }
 };
 
 
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cmath>
+
+#include "Resampler.h"
+
+/**
+ * Modified Bessel function of the first kind, order 0, for the Kaiser window
+ */
+static double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50 && term > sum * 1e-12; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+Resampler::Resampler(int32_t inputRate, int32_t outputRate)
+        : mInputRate(inputRate)
+        , mOutputRate(outputRate) {
+    // the cutoff in cycles per input frame, lowered to the output's Nyquist when downsampling
+    double cutoff = kSincCutoff * std::min(1.0, static_cast<double>(outputRate) / inputRate);
+    mHalfWidth = kSincZeroCrossings / cutoff;
+
+    auto tableSize = static_cast<size_t>(std::ceil(mHalfWidth * kSincPhases)) + 2;
+    mFilter.resize(tableSize);
+    const double windowScale = 1.0 / besselI0(kKaiserBeta);
+    for (size_t i = 0; i < tableSize; i++) {
+        double distance = static_cast<double>(i) / kSincPhases;
+        if (distance >= mHalfWidth) {
+            mFilter[i] = 0.0f;
+            continue;
+        }
+        double x = M_PI * cutoff * distance;
+        double sinc = distance == 0 ? 1.0 : std::sin(x) / x;
+        double ratio = distance / mHalfWidth;
+        double window = besselI0(kKaiserBeta * std::sqrt(1.0 - ratio * ratio)) * windowScale;
+        mFilter[i] = static_cast<float>(cutoff * sinc * window);
+    }
+}
+
+int64_t Resampler::getOutputFrames(int32_t numFrames) const {
+    return (static_cast<int64_t>(numFrames) * mOutputRate + mInputRate - 1) / mInputRate;
+}
+
+/**
+ * Filter tap for an input frame at a distance from the output frame's position
+ */
+float Resampler::filterAt(double distance) const {
+    double index = std::fabs(distance) * kSincPhases;
+    auto i = static_cast<size_t>(index);
+    if (i + 1 >= mFilter.size()) return 0.0f;
+    auto fraction = static_cast<float>(index - i);
+    return mFilter[i] + (mFilter[i + 1] - mFilter[i]) * fraction;
+}
+
+void Resampler::process(const float *input, int32_t numFrames, int32_t channelCount,
+                        std::vector<float> &output) const {
+    int64_t numOutputFrames = getOutputFrames(numFrames);
+    output.assign(static_cast<size_t>(numOutputFrames * channelCount), 0.0f);
+
+    const auto maxTaps = static_cast<size_t>(2 * std::ceil(mHalfWidth) + 2);
+    std::vector<float> taps(maxTaps);
+    for (int64_t n = 0; n < numOutputFrames; n++) {
+        // output frame n sits at input position n * inputRate / outputRate, kept as an exact
+        // integer part and remainder
+        int64_t inputPosition = n * mInputRate;
+        int64_t center = inputPosition / mOutputRate;
+        double fraction = static_cast<double>(inputPosition % mOutputRate) / mOutputRate;
+
+        auto first = static_cast<int64_t>(std::ceil(center + fraction - mHalfWidth));
+        auto last = static_cast<int64_t>(std::floor(center + fraction + mHalfWidth));
+        first = std::max<int64_t>(first, 0);
+        last = std::min<int64_t>(last, numFrames - 1);
+
+        // the taps are shared by every channel
+        int numTaps = 0;
+        for (int64_t k = first; k <= last; k++) {
+            taps[numTaps++] = filterAt(static_cast<double>(k - center) - fraction);
+        }
+        float *target = &output[n * channelCount];
+        for (int32_t c = 0; c < channelCount; c++) {
+            const float *source = input + first * channelCount + c;
+            float sum = 0.0f;
+            for (int t = 0; t < numTaps; t++) {
+                sum += taps[t] * source[t * channelCount];
+            }
+            target[c] = sum;
+        }
+    }
+}
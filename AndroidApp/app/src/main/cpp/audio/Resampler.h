@@ -0,0 +1,64 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DRUMMACHINE_RESAMPLER_H
+#define DRUMMACHINE_RESAMPLER_H
+
+#include <cstdint>
+#include <vector>
+
+constexpr int kSincZeroCrossings = 16; // on each side of the filter, sets its length and steepness
+constexpr int kSincPhases = 512; // filter table entries per input frame, interpolated in between
+constexpr double kSincCutoff = 0.94; // passband edge as a fraction of the lower Nyquist frequency
+constexpr double kKaiserBeta = 9.0; // about 90dB stopband attenuation
+
+/**
+ * Windowed-sinc sample rate converter for whole samples at load time. Any pair of rates works:
+ * the filter is a Kaiser windowed sinc, tabulated at kSincPhases points per input frame and
+ * linearly interpolated, and each output frame's position in the input is computed exactly from
+ * the frame index, so no error builds up along the sample. When downsampling the cutoff drops to
+ * the new Nyquist frequency to avoid aliasing.
+ *
+ * It is too slow for the audio thread, which never needs it: every sample is converted to the
+ * stream's rate once, when it is loaded.
+ */
+class Resampler {
+public:
+    Resampler(int32_t inputRate, int32_t outputRate);
+
+    /**
+     * @param input - interleaved audio at the input rate
+     * @param numFrames - frames in input
+     * @param channelCount - channels in input and output
+     * @param output - replaced with interleaved audio at the output rate
+     */
+    void process(const float *input, int32_t numFrames, int32_t channelCount,
+                 std::vector<float> &output) const;
+
+    /**
+     * @return frames produced from numFrames input frames
+     */
+    int64_t getOutputFrames(int32_t numFrames) const;
+
+private:
+    float filterAt(double distance) const;
+
+    const int32_t mInputRate;
+    const int32_t mOutputRate;
+    double mHalfWidth; // reach of the filter on either side, in input frames
+    std::vector<float> mFilter; // one side of the symmetric filter, kSincPhases per input frame
+};
+
+#endif //DRUMMACHINE_RESAMPLER_H
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <utils/logging.h>
+
+#include "StreamedDataSource.h"
+#include "SamplePrefetcher.h"
+
+SamplePrefetcher::SamplePrefetcher()
+        : mThread(&SamplePrefetcher::run, this) {
+}
+
+SamplePrefetcher::~SamplePrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mIsRunning = false;
+    }
+    mStopped.notify_all();
+    mThread.join();
+}
+
+void SamplePrefetcher::add(StreamedDataSource *source) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mSources.push_back(source);
+}
+
+/**
+ * Stop servicing a source, waits if it is being serviced right now
+ */
+void SamplePrefetcher::remove(StreamedDataSource *source) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mSources.erase(std::remove(mSources.begin(), mSources.end(), source), mSources.end());
+    // the source unmaps its tail itself
+    mCachedBytes -= source->mTailFilled;
+}
+
+/**
+ * Fill in the whole tail of a source on the calling thread and keep it (true), or let it be dropped
+ * again after the usual hold time (false)
+ */
+void SamplePrefetcher::setPinned(StreamedDataSource *source, bool isPinned) {
+    std::lock_guard<std::mutex> lock(mLock);
+    source->mIsPinned = isPinned;
+    if (!isPinned) {
+        source->mLastPlayed = std::chrono::steady_clock::now();
+        return;
+    }
+    size_t length = source->mTailLength - source->mTailFilled;
+    if (length == 0) return;
+    // filled in even if it doesn't fit, a render is wrong without it
+    makeRoom(source, length, std::chrono::steady_clock::now());
+    source->fillNextChunk(length);
+    mCachedBytes += length;
+}
+
+/**
+ * Service every source, one chunk at a time so that a long tail doesn't hold up the other samples,
+ * and only sleep once none of them has anything left to fill in.
+ */
+void SamplePrefetcher::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (mIsRunning) {
+        auto now = std::chrono::steady_clock::now();
+        for (StreamedDataSource *source : mSources) {
+            mCachedBytes -= source->update(now);
+        }
+        // warn again once everything has stopped
+        if (mCachedBytes == 0) mIsOverBudget = false;
+
+        bool hasMoreWork = false;
+        for (StreamedDataSource *source : mSources) {
+            size_t chunkLength = source->nextChunkLength(now);
+            if (chunkLength == 0) continue;
+            if (!makeRoom(source, chunkLength, now)) {
+                // this hit plays its head only, filling in later would cut back in mid-note
+                source->mIsFillRefused = true;
+                continue;
+            }
+            source->fillNextChunk(chunkLength);
+            mCachedBytes += chunkLength;
+            hasMoreWork = true;
+        }
+
+        if (hasMoreWork) {
+            // let add and remove in between chunks
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        } else {
+            mStopped.wait_for(lock, std::chrono::milliseconds(kPrefetchPollMillis));
+        }
+    }
+}
+
+/**
+ * Drop the tails of the least recently played other sources until length more bytes fit in the
+ * cache. Only sources which have finished playing are dropped, the audio thread may still be
+ * reading the tail of one which hasn't.
+ *
+ * @return false if they don't fit even with all of those tails dropped
+ */
+bool SamplePrefetcher::makeRoom(const StreamedDataSource *source, size_t length,
+                                std::chrono::steady_clock::time_point now) {
+    while (mCachedBytes + length > kMaxPrefetchCacheBytes) {
+        StreamedDataSource *oldest = nullptr;
+        for (StreamedDataSource *other : mSources) {
+            if (other != source && !other->mIsPinned && other->mTailFilled > 0 &&
+                other->hasFinished(now) &&
+                (oldest == nullptr || other->mLastPlayed < oldest->mLastPlayed)) {
+                oldest = other;
+            }
+        }
+        if (oldest == nullptr) {
+            if (!mIsOverBudget) {
+                LOGW("Streamed samples need more than %zu KB, a sample plays its head only",
+                     kMaxPrefetchCacheBytes / 1024);
+                mIsOverBudget = true;
+            }
+            return false;
+        }
+        mCachedBytes -= oldest->dropTail();
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRUMMACHINE_SAMPLEPREFETCHER_H
+#define DRUMMACHINE_SAMPLEPREFETCHER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class StreamedDataSource;
+
+constexpr int kPrefetchPollMillis = 5; // how often the prefetch thread looks for triggered samples
+constexpr size_t kMaxPrefetchCacheBytes = 16 * 1024 * 1024; // filled in tails of the whole kit
+
+/**
+ * A background thread shared by all the streamed samples of a kit. It fills in the tail of a sample
+ * once it has been triggered, in order and just ahead of the play head, and drops the tail again
+ * once the sample has stopped playing, so the audio thread never takes a page fault or decodes.
+ *
+ * The filled in tails are a cache of at most kMaxPrefetchCacheBytes for the whole kit. When a
+ * sample needs more, the tails of samples which have finished playing are dropped, least recently
+ * played first. If that isn't enough the hit plays its head only, a tail is never dropped while it
+ * may still be read. A pinned sample has all of its tail filled in at once and is never dropped,
+ * even when that goes over the limit.
+ *
+ * The audio thread only sets a flag on the source, which this thread polls.
+ */
+class SamplePrefetcher {
+public:
+    SamplePrefetcher();
+    ~SamplePrefetcher();
+
+    void add(StreamedDataSource *source);
+    void remove(StreamedDataSource *source);
+    void setPinned(StreamedDataSource *source, bool isPinned);
+
+private:
+    void run();
+    bool makeRoom(const StreamedDataSource *source, size_t length,
+                  std::chrono::steady_clock::time_point now);
+
+    std::mutex mLock; // guards everything below, held while a source is serviced
+    std::condition_variable mStopped;
+    bool mIsRunning = true;
+    std::vector<StreamedDataSource*> mSources;
+    size_t mCachedBytes = 0; // filled in tail bytes of all the sources
+    bool mIsOverBudget = false;
+    std::thread mThread; // last, so it starts once everything else is constructed
+};
+
+#endif //DRUMMACHINE_SAMPLEPREFETCHER_H
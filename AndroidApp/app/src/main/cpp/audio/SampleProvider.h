@@ -0,0 +1,42 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DRUMMACHINE_SAMPLEPROVIDER_H
+#define DRUMMACHINE_SAMPLEPROVIDER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "DataSource.h"
+
+/**
+ * Loads the kit samples by name: from the APK assets on Android, from a directory on the host.
+ * Samples are loaded concurrently, so loadSample must be safe to call from several threads.
+ */
+class SampleProvider {
+public:
+    virtual ~SampleProvider() = default;
+
+    /**
+     * @param channelCount - channels to convert the sample to
+     * @param sampleRate - rate to resample the sample to
+     * @return the sample, or nullptr if it could not be loaded
+     */
+    virtual std::shared_ptr<DataSource> loadSample(const std::string &name, int32_t channelCount,
+                                                   int32_t sampleRate) = 0;
+};
+
+#endif //DRUMMACHINE_SAMPLEPROVIDER_H
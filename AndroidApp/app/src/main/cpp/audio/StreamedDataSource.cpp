@@ -0,0 +1,227 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <utils/logging.h>
+
+#include "AdpcmDataSource.h"
+#include "MappedDataSource.h"
+#include "StreamedDataSource.h"
+#include "WavDecoder.h"
+
+StreamedDataSource* StreamedDataSource::newFromFd(int fd, off_t offset, size_t length,
+                                                  const char *name, int32_t channelCount,
+                                                  int32_t sampleRate,
+                                                  std::shared_ptr<SamplePrefetcher> prefetcher) {
+
+    // a mapping starts on a page boundary, the file inside an APK doesn't
+    off_t mappingOffset = offset - offset % static_cast<off_t>(pageSize());
+    size_t mappingLength = length + static_cast<size_t>(offset - mappingOffset);
+    void *mapping = mmap(nullptr, mappingLength, PROT_READ, MAP_PRIVATE, fd, mappingOffset);
+    if (mapping == MAP_FAILED){
+        LOGE("Could not map %s", name);
+        return nullptr;
+    }
+    const uint8_t *file = static_cast<const uint8_t*>(mapping) + (offset - mappingOffset);
+
+    WavInfo info;
+    size_t audioOffset = 0;
+    size_t audioBytes = 0;
+    StreamedDataSource *source = nullptr;
+    if (WavDecoder::parse(file, length, info, audioOffset, audioBytes)) {
+        if (info.isAdpcm) {
+            // copies the compressed audio, the mapping isn't needed after that
+            source = AdpcmDataSource::newFromWav(file + audioOffset, audioBytes, info, name,
+                                                 channelCount, sampleRate, prefetcher);
+        } else {
+            // takes over the mapping
+            source = MappedDataSource::newFromMapping(mapping, mappingLength, file + audioOffset,
+                                                      info, name, channelCount, sampleRate,
+                                                      prefetcher);
+            if (source != nullptr) return source;
+        }
+    }
+    munmap(mapping, mappingLength);
+    return source;
+}
+
+size_t StreamedDataSource::pageSize() {
+    static const auto size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+/**
+ * Read one byte of every page in a range, which faults the pages in on this thread
+ */
+void StreamedDataSource::touchPages(const uint8_t *start, size_t length) {
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; i += pageSize()) {
+        sum += *static_cast<const volatile uint8_t*>(start + i);
+    }
+    (void) sum;
+}
+
+/**
+ * Keep a range resident if we're allowed to, otherwise just fault it in
+ */
+void StreamedDataSource::lockPages(uint8_t *start, size_t length) {
+    if (mlock(start, length) != 0){
+        LOGW("Could not lock the head of a streamed sample, it may be paged out");
+        touchPages(start, length);
+    }
+}
+
+/**
+ * @param start - page aligned start of the memory holding the sample
+ * @param data - first frame
+ * @return bytes from start to the end of the page holding the last frame of the attack
+ */
+size_t StreamedDataSource::headLength(const uint8_t *start, const int16_t *data, int32_t numFrames,
+                                      int32_t channelCount, int32_t sampleRate) {
+    int32_t headFrames = std::min(numFrames, sampleRate * kStreamingHeadMillis / 1000);
+    auto headEnd = reinterpret_cast<const uint8_t*>(data + headFrames * channelCount);
+    return (static_cast<size_t>(headEnd - start) + pageSize() - 1) / pageSize() * pageSize();
+}
+
+void StreamedDataSource::startStreaming(uint8_t *tail, size_t tailLength, int32_t sampleRate) {
+    mTail = tail;
+    mTailLength = tailLength;
+    mTailFilled = 0;
+    mSampleRate = sampleRate;
+    mSampleDuration = std::chrono::milliseconds(
+            static_cast<int64_t>(getTotalFrames()) * 1000 / sampleRate);
+    mHoldDuration = mSampleDuration + std::chrono::milliseconds(kStreamingTailHoldMillis);
+    scanSample();
+
+    // nothing is sounding yet, only the head can be played
+    mReadableFrames.store(framesBefore(0), std::memory_order_release);
+    mLastPlayed = std::chrono::steady_clock::now() - mHoldDuration;
+    mPlayStart = mLastPlayed;
+    mPrefetcher->add(this);
+}
+
+void StreamedDataSource::stopStreaming() {
+    mPrefetcher->remove(this);
+}
+
+/**
+ * Run over the whole sample once while loading, to build its envelope and to time how long its tail
+ * takes to fill in. The tail is filled in and dropped again a chunk at a time, so loading never
+ * needs more than a chunk of it resident.
+ */
+void StreamedDataSource::scanSample() {
+    const int16_t *data = getData();
+    const int32_t channelCount = getChannelCount();
+    mEnvelope.assign(static_cast<size_t>(getTotalFrames() / kEnvelopeBlockFrames + 1), 0);
+
+    // the head is resident already
+    int32_t frame = framesBefore(0);
+    addToEnvelope(mEnvelope, data, 0, frame, channelCount);
+
+    std::chrono::steady_clock::duration fillTime {};
+    for (size_t offset = 0; offset < mTailLength; offset += kPrefetchChunkBytes) {
+        size_t chunkLength = std::min(kPrefetchChunkBytes, mTailLength - offset);
+        auto fillStart = std::chrono::steady_clock::now();
+        fillTail(offset, chunkLength);
+        fillTime += std::chrono::steady_clock::now() - fillStart;
+
+        int32_t endFrame = framesBefore(offset + chunkLength);
+        addToEnvelope(mEnvelope, data, frame, endFrame - frame, channelCount);
+        madvise(mTail + offset, chunkLength, MADV_DONTNEED);
+        frame = endFrame;
+    }
+    mTailFillMillis = std::chrono::duration<double, std::milli>(fillTime).count();
+}
+
+/**
+ * @return offset in the tail of the first byte of a frame, 0 for the frames of the head
+ */
+size_t StreamedDataSource::tailOffsetOfFrame(int32_t frame) const {
+    auto frameStart = reinterpret_cast<const uint8_t*>(
+            getData() + static_cast<size_t>(frame) * getChannelCount());
+    if (frameStart <= mTail) return 0;
+    return std::min(static_cast<size_t>(frameStart - mTail), mTailLength);
+}
+
+/**
+ * @return the number of frames which end at or before an offset in the tail
+ */
+int32_t StreamedDataSource::framesBefore(size_t tailOffset) const {
+    if (tailOffset >= mTailLength) return getTotalFrames();
+    const size_t frameBytes = getChannelCount() * sizeof(int16_t);
+    auto dataOffset = static_cast<size_t>(mTail + tailOffset -
+                                          reinterpret_cast<const uint8_t*>(getData()));
+    return static_cast<int32_t>(std::min<size_t>(dataOffset / frameBytes,
+                                                 static_cast<size_t>(getTotalFrames())));
+}
+
+/**
+ * Pick up a trigger from the audio thread, and drop the tail once the sample hasn't been played
+ * for a while
+ *
+ * @return bytes of the tail dropped
+ */
+size_t StreamedDataSource::update(std::chrono::steady_clock::time_point now) {
+    if (mIsPrefetchRequested.exchange(false)) {
+        // an older hit which is still sounding is further into the sample than the new one
+        if (now - mPlayStart > mSampleDuration) {
+            mPlayStart = now;
+        }
+        mLastPlayed = now;
+        mIsFillRefused = false;
+    }
+    return !mIsPinned && now - mLastPlayed > mHoldDuration ? dropTail() : 0;
+}
+
+/**
+ * @return bytes of the tail to fill in next, 0 if it is filled in far enough ahead of the play head
+ */
+size_t StreamedDataSource::nextChunkLength(std::chrono::steady_clock::time_point now) const {
+    if (mTailFilled >= mTailLength || mIsFillRefused || now - mLastPlayed > mHoldDuration) {
+        return 0;
+    }
+
+    double aheadSeconds = std::chrono::duration<double>(now - mPlayStart).count() +
+                          kPrefetchAheadMillis / 1000.0;
+    auto aheadFrames = static_cast<int64_t>(aheadSeconds * mSampleRate);
+    size_t aheadLength = aheadFrames >= getTotalFrames()
+            ? mTailLength : tailOffsetOfFrame(static_cast<int32_t>(aheadFrames));
+    if (mTailFilled >= aheadLength) return 0;
+    return std::min(kPrefetchChunkBytes, mTailLength - mTailFilled);
+}
+
+void StreamedDataSource::fillNextChunk(size_t length) {
+    fillTail(mTailFilled, length);
+    mTailFilled += length;
+    mReadableFrames.store(framesBefore(mTailFilled), std::memory_order_release);
+}
+
+/**
+ * Only called once the sample has finished playing, so no voice is reading the tail any more
+ *
+ * @return bytes of the tail dropped
+ */
+size_t StreamedDataSource::dropTail() {
+    size_t length = mTailFilled;
+    if (length > 0) {
+        mReadableFrames.store(framesBefore(0), std::memory_order_release);
+        madvise(mTail, length, MADV_DONTNEED);
+        mTailFilled = 0;
+    }
+    return length;
+}
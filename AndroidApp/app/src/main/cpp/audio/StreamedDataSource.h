@@ -0,0 +1,120 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRUMMACHINE_STREAMEDDATASOURCE_H
+#define DRUMMACHINE_STREAMEDDATASOURCE_H
+
+#include <sys/types.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "DataSource.h"
+#include "SamplePrefetcher.h"
+
+constexpr int kStreamingHeadMillis = 250; // attack kept resident, covers the prefetch latency
+constexpr int kStreamingTailHoldMillis = 2000; // tail kept resident after the sample has finished
+constexpr int kPrefetchAheadMillis = 1000; // how far ahead of the play head the tail is filled in
+constexpr size_t kPrefetchChunkBytes = 256 * 1024; // filled per pass of the prefetch thread
+
+/**
+ * A sample whose data is only partly resident. The head, the attack, is always there. The tail is
+ * filled in by the SamplePrefetcher when the sample is triggered, in order and just ahead of the
+ * play head, and dropped again once the sample has stopped playing, so a large kit only costs
+ * memory for what is sounding.
+ */
+class StreamedDataSource : public DataSource {
+
+public:
+    void prefetch() override { mIsPrefetchRequested = true; };
+    int32_t getReadableFrames() const override {
+        return mReadableFrames.load(std::memory_order_acquire);
+    };
+    std::vector<int16_t> getEnvelope() const override { return mEnvelope; };
+    double getTailFillMillis() const override { return mTailFillMillis; };
+    void setPinned(bool isPinned) override { mPrefetcher->setPinned(this, isPinned); };
+
+    /**
+     * Stream a WAV file if it suits one of the streamed sources
+     *
+     * @param fd - the file, or the APK for an uncompressed asset. Can be closed afterwards.
+     * @param offset - start of the WAV file in fd
+     * @param length - size of the WAV file
+     * @param name - for logging
+     * @param prefetcher - the thread which will fill in the tail
+     * @return the sample, or nullptr if the caller should decode it into memory instead
+     */
+    static StreamedDataSource* newFromFd(int fd, off_t offset, size_t length, const char *name,
+                                         int32_t channelCount, int32_t sampleRate,
+                                         std::shared_ptr<SamplePrefetcher> prefetcher);
+
+protected:
+    explicit StreamedDataSource(std::shared_ptr<SamplePrefetcher> prefetcher)
+            : mPrefetcher(std::move(prefetcher)) {};
+
+    static size_t pageSize();
+    static void touchPages(const uint8_t *start, size_t length);
+    static void lockPages(uint8_t *start, size_t length);
+    static size_t headLength(const uint8_t *start, const int16_t *data, int32_t numFrames,
+                             int32_t channelCount, int32_t sampleRate);
+
+    // Register with the prefetcher once the head is resident. The tail must start on a page.
+    void startStreaming(uint8_t *tail, size_t tailLength, int32_t sampleRate);
+    // Must be called by the destructor of the subclass, before the tail goes away
+    void stopStreaming();
+    // Make [offset, offset + length) of the tail resident, called on the prefetch thread
+    virtual void fillTail(size_t offset, size_t length) = 0;
+
+private:
+    friend class SamplePrefetcher;
+
+    void scanSample();
+    size_t tailOffsetOfFrame(int32_t frame) const;
+    int32_t framesBefore(size_t tailOffset) const;
+
+    // Called by the prefetch thread, with the prefetcher's lock held
+    size_t update(std::chrono::steady_clock::time_point now);
+    size_t nextChunkLength(std::chrono::steady_clock::time_point now) const;
+    void fillNextChunk(size_t length);
+    size_t dropTail();
+    bool hasFinished(std::chrono::steady_clock::time_point now) const {
+        return now - mLastPlayed > mSampleDuration;
+    };
+
+    const std::shared_ptr<SamplePrefetcher> mPrefetcher;
+    std::atomic<bool> mIsPrefetchRequested { false };
+    // Frames which end before the filled in part of the tail does. Stored after the tail is filled
+    // in, so the audio thread sees the data of every frame it reads.
+    std::atomic<int32_t> mReadableFrames { 0 };
+    std::vector<int16_t> mEnvelope; // built once while loading, see scanSample
+    double mTailFillMillis = 0;
+
+    // Only used by the prefetch thread once streaming has started
+    uint8_t *mTail = nullptr;
+    size_t mTailLength = 0;
+    size_t mTailFilled = 0; // bytes of the tail made resident so far
+    bool mIsPinned = false; // the whole tail is filled in and never dropped
+    bool mIsFillRefused = false; // the cache was full, nothing more is filled in until a new hit
+    int32_t mSampleRate = 0;
+    std::chrono::steady_clock::duration mSampleDuration;
+    std::chrono::steady_clock::duration mHoldDuration; // how long the tail stays after a trigger
+    std::chrono::steady_clock::time_point mPlayStart; // trigger of the oldest hit still sounding
+    std::chrono::steady_clock::time_point mLastPlayed; // trigger of the newest hit
+};
+
+#endif //DRUMMACHINE_STREAMEDDATASOURCE_H
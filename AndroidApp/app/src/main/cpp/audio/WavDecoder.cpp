@@ -0,0 +1,303 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utils/logging.h>
+
+#include "ImaAdpcm.h"
+#include "Resampler.h"
+#include "WavDecoder.h"
+
+constexpr uint16_t kFormatPcm = 1;
+constexpr uint16_t kFormatFloat = 3;
+constexpr uint16_t kFormatImaAdpcm = 0x11;
+constexpr uint16_t kFormatExtensible = 0xFFFE;
+
+static uint16_t readU16(const uint8_t *p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t readU32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/**
+ * @return the sample, or 0 for NaN and infinity. They are found by their exponent bits, as the app
+ * is built with -ffast-math, which lets the compiler assume std::isnan is always false.
+ */
+static double readFloat(const uint8_t *p, int32_t bytesPerSample) {
+    if (bytesPerSample == 4) {
+        uint32_t bits = readU32(p);
+        if ((bits & 0x7f800000u) == 0x7f800000u) return 0;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    uint64_t bits = readU32(p) | (static_cast<uint64_t>(readU32(p + 4)) << 32);
+    if ((bits & 0x7ff0000000000000u) == 0x7ff0000000000000u) return 0;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static int16_t clampToI16(int32_t sample) {
+    return static_cast<int16_t>(std::min(std::max(sample, -32768), 32767));
+}
+
+/**
+ * Full scale float to int16_t, rounding to nearest
+ *
+ * @param value - a finite sample, see readFloat
+ */
+static int16_t floatToI16(double value) {
+    return static_cast<int16_t>(std::lround(std::min(std::max(value * 32768.0, -32768.0), 32767.0)));
+}
+
+/**
+ * Read one sample of any supported encoding as int16_t, rounding to nearest
+ */
+static int16_t readSample(const uint8_t *p, int32_t bytesPerSample, bool isFloat) {
+    if (isFloat) {
+        return floatToI16(readFloat(p, bytesPerSample));
+    }
+    switch (bytesPerSample) {
+        case 1:
+            return static_cast<int16_t>((p[0] - 128) * 256); // 8 bit WAV is unsigned
+        case 2:
+            return static_cast<int16_t>(readU16(p));
+        case 3: {
+            // sign extend through the top byte of an int32_t
+            int32_t value = static_cast<int32_t>((p[0] << 8) | (p[1] << 16) |
+                                                 (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+            return clampToI16((value + 128) >> 8);
+        }
+        default: {
+            int64_t value = static_cast<int32_t>(readU32(p));
+            return clampToI16(static_cast<int32_t>((value + 32768) >> 16));
+        }
+    }
+}
+
+/**
+ * Read one sample of any supported encoding as float, full scale at 1.0
+ */
+static float readSampleAsFloat(const uint8_t *p, int32_t bytesPerSample, bool isFloat) {
+    if (isFloat) {
+        // it would be clipped at full scale anyway, and this keeps a huge double from overflowing
+        double value = std::min(std::max(readFloat(p, bytesPerSample), -1.0), 1.0);
+        return static_cast<float>(value);
+    }
+    switch (bytesPerSample) {
+        case 1:
+            return (p[0] - 128) / 128.0f;
+        case 2:
+            return static_cast<int16_t>(readU16(p)) / 32768.0f;
+        case 3: {
+            int32_t value = static_cast<int32_t>((p[0] << 8) | (p[1] << 16) |
+                                                 (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+            return value / 8388608.0f;
+        }
+        default:
+            return static_cast<int32_t>(readU32(p)) / 2147483648.0f;
+    }
+}
+
+/**
+ * Convert the frames of the data chunk to the output channel layout. Mono is copied to every
+ * output channel, stereo is mixed down for a mono output and extra channels are dropped.
+ */
+template <typename Sample, typename ReadSample>
+static void convertFrames(const uint8_t *audio, int32_t numFrames, int32_t blockAlign,
+                          int32_t bytesPerSample, int32_t sourceChannelCount,
+                          int32_t channelCount, ReadSample readSample, Sample *output) {
+    for (int32_t i = 0; i < numFrames; i++) {
+        const uint8_t *frame = audio + static_cast<size_t>(i) * blockAlign;
+        if (channelCount == 1 && sourceChannelCount >= 2) {
+            *output++ = static_cast<Sample>((readSample(frame) + readSample(frame + bytesPerSample)) / 2);
+            continue;
+        }
+        for (int32_t c = 0; c < channelCount; c++) {
+            int32_t sourceChannel = std::min(c, sourceChannelCount - 1);
+            *output++ = readSample(frame + sourceChannel * bytesPerSample);
+        }
+    }
+}
+
+bool WavDecoder::parse(const uint8_t *data, size_t numBytes, WavInfo &info, size_t &audioOffset,
+                       size_t &audioBytes) {
+    if (numBytes < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    uint16_t format = 0;
+    int32_t sourceChannelCount = 0;
+    int32_t sourceSampleRate = 0;
+    int32_t blockAlign = 0;
+    int32_t bitsPerSample = 0;
+    const uint8_t *audio = nullptr;
+    size_t numAudioBytes = 0;
+    uint32_t factFrames = 0; // frame count of compressed audio, if the file has a fact chunk
+
+    // walk the chunks, each is padded to an even size
+    size_t offset = 12;
+    while (offset + 8 <= numBytes) {
+        const uint8_t *chunk = data + offset;
+        size_t chunkSize = readU32(chunk + 4);
+        size_t available = numBytes - offset - 8;
+        if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16 && available >= 16) {
+            format = readU16(chunk + 8);
+            sourceChannelCount = readU16(chunk + 10);
+            sourceSampleRate = static_cast<int32_t>(readU32(chunk + 12));
+            blockAlign = readU16(chunk + 20);
+            bitsPerSample = readU16(chunk + 22);
+            // WAVE_FORMAT_EXTENSIBLE keeps the real format in the first 2 bytes of the sub format
+            if (format == kFormatExtensible && chunkSize >= 40 && available >= 40) {
+                format = readU16(chunk + 32);
+            }
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            // streaming writers may leave the size at 0 or 0xFFFFFFFF
+            audio = chunk + 8;
+            numAudioBytes = (chunkSize == 0 || chunkSize > available) ? available : chunkSize;
+        } else if (memcmp(chunk, "fact", 4) == 0 && chunkSize >= 4 && available >= 4) {
+            factFrames = readU32(chunk + 8);
+        }
+        if (chunkSize > available) break;
+        offset += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    bool isFloat = format == kFormatFloat;
+    bool isAdpcm = format == kFormatImaAdpcm;
+    int32_t bytesPerSample = bitsPerSample / 8;
+    int32_t framesPerBlock = isAdpcm ? ImaAdpcm::framesPerBlock(blockAlign, sourceChannelCount) : 1;
+    bool isSupported = (format == kFormatPcm && bitsPerSample >= 8 && bitsPerSample <= 32 && bitsPerSample % 8 == 0) ||
+                       (isFloat && (bitsPerSample == 32 || bitsPerSample == 64)) ||
+                       (isAdpcm && bitsPerSample == 4 && framesPerBlock > 0);
+    if (audio == nullptr || !isSupported || sourceChannelCount <= 0 || sourceSampleRate <= 0 ||
+        blockAlign < sourceChannelCount * bytesPerSample) {
+        LOGE("Unsupported WAV file, format %d, %d bit, %d channels", format, bitsPerSample,
+             sourceChannelCount);
+        return false;
+    }
+
+    auto numFrames = static_cast<int32_t>(numAudioBytes / blockAlign);
+    if (isAdpcm) {
+        // a short final block still holds its header frame and whole groups of 8 frames
+        size_t lastBlockBytes = numAudioBytes % blockAlign;
+        numFrames = numFrames * framesPerBlock + ImaAdpcm::framesPerBlock(
+                static_cast<int32_t>(lastBlockBytes), sourceChannelCount);
+        // the last block is padded, the fact chunk has the real length
+        if (factFrames > 0 && factFrames < static_cast<uint32_t>(numFrames)) {
+            numFrames = static_cast<int32_t>(factFrames);
+        }
+    }
+    if (numFrames == 0) {
+        LOGE("WAV file has no audio");
+        return false;
+    }
+
+    info.sampleRate = sourceSampleRate;
+    info.channelCount = sourceChannelCount;
+    info.bitsPerSample = bitsPerSample;
+    info.isFloat = isFloat;
+    info.isAdpcm = isAdpcm;
+    info.blockAlign = blockAlign;
+    info.framesPerBlock = framesPerBlock;
+    info.numFrames = numFrames;
+    audioOffset = static_cast<size_t>(audio - data);
+    audioBytes = numAudioBytes;
+    return true;
+}
+
+void WavDecoder::decodeAdpcm(const uint8_t *audio, size_t audioBytes, const WavInfo &info,
+                             int32_t firstFrame, int32_t numFrames, int16_t *output) {
+    const int32_t channelCount = info.channelCount;
+    std::vector<int16_t> block(static_cast<size_t>(info.framesPerBlock) * channelCount);
+    const int32_t endFrame = firstFrame + numFrames;
+    int32_t frame = firstFrame;
+    while (frame < endFrame) {
+        int32_t blockIdx = frame / info.framesPerBlock;
+        int32_t blockStart = blockIdx * info.framesPerBlock;
+        size_t blockOffset = static_cast<size_t>(blockIdx) * info.blockAlign;
+        int32_t numDecoded = 0;
+        if (blockOffset < audioBytes) {
+            numDecoded = ImaAdpcm::decodeBlock(
+                    audio + blockOffset, std::min<size_t>(info.blockAlign, audioBytes - blockOffset),
+                    channelCount, block.data());
+        }
+
+        // copy the frames we want, silence past the end of a truncated file
+        int32_t from = frame - blockStart;
+        int32_t to = std::min(endFrame - blockStart, info.framesPerBlock);
+        int32_t numCopied = std::max(0, std::min(to, numDecoded) - from);
+        std::copy_n(block.data() + from * channelCount, numCopied * channelCount, output);
+        std::fill_n(output + numCopied * channelCount, (to - from - numCopied) * channelCount, 0);
+        output += (to - from) * channelCount;
+        frame = blockStart + to;
+    }
+}
+
+bool WavDecoder::decode(const uint8_t *data, size_t numBytes, int32_t channelCount,
+                        int32_t sampleRate, std::vector<int16_t> &samples, WavInfo *info) {
+    WavInfo format;
+    size_t audioOffset = 0;
+    size_t audioBytes = 0;
+    if (!parse(data, numBytes, format, audioOffset, audioBytes)) {
+        return false;
+    }
+
+    const uint8_t *audio = data + audioOffset;
+    const int32_t numFrames = format.numFrames;
+    int32_t blockAlign = format.blockAlign;
+    int32_t bytesPerSample = format.bitsPerSample / 8;
+    const int32_t sourceChannelCount = format.channelCount;
+    const int32_t sourceSampleRate = format.sampleRate;
+    const bool isFloat = format.isFloat;
+
+    // ADPCM is expanded to 16 bit PCM first, then converted like any other file
+    std::vector<int16_t> adpcmFrames;
+    if (format.isAdpcm) {
+        adpcmFrames.resize(static_cast<size_t>(numFrames) * sourceChannelCount);
+        decodeAdpcm(audio, audioBytes, format, 0, numFrames, adpcmFrames.data());
+        audio = reinterpret_cast<const uint8_t*>(adpcmFrames.data()); // little endian, like the file
+        blockAlign = sourceChannelCount * static_cast<int32_t>(sizeof(int16_t));
+        bytesPerSample = sizeof(int16_t);
+    }
+
+    if (sourceSampleRate == sampleRate || sampleRate <= 0) {
+        samples.resize(static_cast<size_t>(numFrames) * channelCount);
+        convertFrames(audio, numFrames, blockAlign, bytesPerSample, sourceChannelCount, channelCount,
+                      [=](const uint8_t *p) { return readSample(p, bytesPerSample, isFloat); },
+                      samples.data());
+    } else {
+        // resample in float, so that the only rounding to 16 bit is the final one
+        std::vector<float> sourceAudio(static_cast<size_t>(numFrames) * channelCount);
+        convertFrames(audio, numFrames, blockAlign, bytesPerSample, sourceChannelCount, channelCount,
+                      [=](const uint8_t *p) { return readSampleAsFloat(p, bytesPerSample, isFloat); },
+                      sourceAudio.data());
+        std::vector<float> resampled;
+        Resampler(sourceSampleRate, sampleRate).process(sourceAudio.data(), numFrames, channelCount,
+                                                       resampled);
+        samples.resize(resampled.size());
+        std::transform(resampled.begin(), resampled.end(), samples.begin(), floatToI16);
+    }
+
+    if (info != nullptr) {
+        *info = format;
+    }
+    return true;
+}
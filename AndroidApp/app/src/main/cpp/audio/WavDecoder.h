@@ -0,0 +1,86 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DRUMMACHINE_WAVDECODER_H
+#define DRUMMACHINE_WAVDECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Format of a decoded WAV file, as stored in the file
+ */
+struct WavInfo {
+    int32_t sampleRate = 0;
+    int32_t channelCount = 0;
+    int32_t bitsPerSample = 0;
+    bool isFloat = false;
+    bool isAdpcm = false; // IMA ADPCM, see ImaAdpcm
+    int32_t blockAlign = 0; // bytes per frame, or per block for ADPCM
+    int32_t framesPerBlock = 1;
+    int32_t numFrames = 0; // in the file, before any resampling
+};
+
+/**
+ * Decodes RIFF/WAV files held in memory. Walks the chunks, so LIST, fact etc. chunks before or
+ * after the audio are skipped rather than played as audio. Reads 8, 16, 24 and 32 bit integer PCM
+ * and 32 or 64 bit float, plain or WAVE_FORMAT_EXTENSIBLE, with any number of channels, as well as
+ * 4 bit IMA ADPCM.
+ */
+class WavDecoder {
+public:
+    /**
+     * Find the audio in a file without converting it
+     *
+     * @param data - the file, only the chunk headers are read
+     * @param numBytes - size of the file
+     * @param info - filled in with the file's format
+     * @param audioOffset - set to the offset of the first frame from the start of the file
+     * @param audioBytes - set to the size of the audio
+     * @return false if this is not a WAV file or the format is not supported
+     */
+    static bool parse(const uint8_t *data, size_t numBytes, WavInfo &info, size_t &audioOffset,
+                      size_t &audioBytes);
+
+    /**
+     * Decode some of the frames of an IMA ADPCM file, only the blocks which hold them are decoded
+     *
+     * @param audio - the audio found by parse
+     * @param audioBytes - its size
+     * @param info - the format found by parse
+     * @param output - room for numFrames frames, in the file's channel layout
+     */
+    static void decodeAdpcm(const uint8_t *audio, size_t audioBytes, const WavInfo &info,
+                            int32_t firstFrame, int32_t numFrames, int16_t *output);
+
+    /**
+     * Convert a whole file to interleaved int16_t at the stream's rate, once at load time so that
+     * nothing is converted on the render path. Mono is copied to every output channel, extra
+     * channels are dropped, and a file at another rate goes through a Resampler.
+     *
+     * @param data - the file
+     * @param numBytes - size of the file
+     * @param channelCount - channels of the output
+     * @param sampleRate - rate of the output, 0 to keep the file's rate
+     * @param samples - replaced with the decoded audio
+     * @param info - filled in with the file's own format, may be null
+     * @return false if this is not a WAV file or the format is not supported
+     */
+    static bool decode(const uint8_t *data, size_t numBytes, int32_t channelCount,
+                       int32_t sampleRate, std::vector<int16_t> &samples, WavInfo *info = nullptr);
+};
+
+#endif //DRUMMACHINE_WAVDECODER_H
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "WavWriter.h"
+#include "utils/logging.h"
+
+constexpr uint32_t kWavHeaderBytes = 44;
+
+/**
+ * Create the file and reserve space for the header
+ *
+ * @return false if the file can't be created
+ */
+bool WavWriter::open(const char *path, int32_t sampleRate, int32_t channelCount) {
+    close();
+    mFile = fopen(path, "wb");
+    if (mFile == nullptr) {
+        LOGE("Could not create %s", path);
+        return false;
+    }
+    mSampleRate = sampleRate;
+    mChannelCount = channelCount;
+    mDataBytes = 0;
+    mHasError = false;
+    writeHeader(0);
+    return !mHasError;
+}
+
+/**
+ * Append interleaved frames to the file
+ */
+bool WavWriter::write(const int16_t *data, int32_t numFrames) {
+    if (mFile == nullptr || mHasError) return false;
+
+    // WAV is little endian, lay the bytes out explicitly so the file is right on any host
+    constexpr int32_t kChunkSamples = 1024;
+    uint8_t bytes[kChunkSamples * 2];
+    const int32_t numSamples = numFrames * mChannelCount;
+    for (int32_t start = 0; start < numSamples; start += kChunkSamples) {
+        int32_t chunkSamples = std::min(kChunkSamples, numSamples - start);
+        for (int32_t i = 0; i < chunkSamples; ++i) {
+            auto sample = static_cast<uint16_t>(data[start + i]);
+            bytes[2 * i] = static_cast<uint8_t>(sample);
+            bytes[2 * i + 1] = static_cast<uint8_t>(sample >> 8);
+        }
+        auto chunkBytes = static_cast<size_t>(chunkSamples) * 2;
+        if (fwrite(bytes, 1, chunkBytes, mFile) != chunkBytes) {
+            mHasError = true;
+            return false;
+        }
+    }
+    mDataBytes += static_cast<uint32_t>(numSamples) * 2;
+    return true;
+}
+
+/**
+ * Fill in the sizes in the header and close the file
+ *
+ * @return false if anything failed to be written
+ */
+bool WavWriter::close() {
+    if (mFile == nullptr) return false;
+    if (fseek(mFile, 0, SEEK_SET) == 0) {
+        writeHeader(mDataBytes);
+    } else {
+        mHasError = true;
+    }
+    if (fclose(mFile) != 0) {
+        mHasError = true;
+    }
+    mFile = nullptr;
+    return !mHasError;
+}
+
+void WavWriter::writeHeader(uint32_t dataBytes) {
+    const uint32_t blockAlign = static_cast<uint32_t>(mChannelCount) * 2;
+    const uint32_t byteRate = static_cast<uint32_t>(mSampleRate) * blockAlign;
+    const uint32_t fields[] = {
+            0x46464952, kWavHeaderBytes - 8 + dataBytes, 0x45564157, // "RIFF", size, "WAVE"
+            0x20746d66, 16,                                            // "fmt ", chunk size
+            1 | (static_cast<uint32_t>(mChannelCount) << 16),          // PCM, channels
+            static_cast<uint32_t>(mSampleRate), byteRate,
+            blockAlign | (16 << 16),                                   // block align, bits
+            0x61746164, dataBytes,                                     // "data", size
+    };
+    for (uint32_t field : fields) {
+        uint8_t bytes[4] = { static_cast<uint8_t>(field), static_cast<uint8_t>(field >> 8),
+                             static_cast<uint8_t>(field >> 16), static_cast<uint8_t>(field >> 24) };
+        if (fwrite(bytes, 1, 4, mFile) != 4) {
+            mHasError = true;
+        }
+    }
+}
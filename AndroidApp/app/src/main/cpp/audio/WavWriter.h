@@ -0,0 +1,48 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRUMMACHINE_WAVWRITER_H
+#define DRUMMACHINE_WAVWRITER_H
+
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * Streams 16 bit PCM to a RIFF/WAV file. The header is written up front and its sizes are filled
+ * in by close(), so the length doesn't have to be known in advance.
+ */
+class WavWriter {
+public:
+    WavWriter() = default;
+    ~WavWriter() { close(); }
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+
+    bool open(const char *path, int32_t sampleRate, int32_t channelCount);
+    bool write(const int16_t *data, int32_t numFrames);
+    bool close();
+
+private:
+    void writeHeader(uint32_t dataBytes);
+
+    FILE *mFile = nullptr;
+    int32_t mSampleRate = 0;
+    int32_t mChannelCount = 0;
+    uint32_t mDataBytes = 0;
+    bool mHasError = false;
+};
+
+#endif //DRUMMACHINE_WAVWRITER_H
@@ -14,13 +14,27 @@
  * limitations under the License.
  */
 #include <jni.h>
+#include <algorithm>
 #include <memory>
 
 #include <android/asset_manager_jni.h>
 
 #include "utils/logging.h"
 #include "DrumMachine.h"
+#include "audio/AAssetSampleProvider.h"
+#include "audio/OboeAudioSink.h"
 
+/**
+ * Voices of the kit's tracks on a device: the cymbals ring for a long time, so a new hit cuts the
+ * quietest of them rather than the one which started first, and metronome clicks never overlap
+ */
+static void configureTrackVoices(DrumMachine &drumMachine) {
+    constexpr int kFingerCymbalTrack = 1;
+    constexpr int kSplashTrack = 3;
+    drumMachine.setTrackVoices(kFingerCymbalTrack, kDefaultMaxVoices, VoiceStealPolicy::Quietest);
+    drumMachine.setTrackVoices(kSplashTrack, kDefaultMaxVoices, VoiceStealPolicy::Quietest);
+    drumMachine.setTrackVoices(kMetronomeTrackIdx, 1, VoiceStealPolicy::Oldest);
+}
 
 extern "C" {
 
@@ -38,7 +52,12 @@ Java_com_cs4347_drumkit_RecordingActivity_native_1onInit(JNIEnv *env, jobject in
         return;
     }
 
-    dmachine = std::make_unique<DrumMachine>(*assetManager);
+    // long samples are streamed from the APK rather than held in memory
+    auto sampleProvider = std::make_unique<AAssetSampleProvider>(
+            *assetManager, std::make_shared<SamplePrefetcher>());
+    dmachine = std::make_unique<DrumMachine>(std::move(sampleProvider),
+                                             std::make_unique<OboeAudioSink>());
+    configureTrackVoices(*dmachine);
     dmachine->init();
 }
 
@@ -97,7 +116,7 @@ Java_com_cs4347_drumkit_RecordingActivity_native_1toggleMetronome(JNIEnv *env, j
  * Export to GenerateTrackActivity
  */
 JNIEXPORT void JNICALL
-Java_com_cs4347_drumkit_GenerateTrackActivity_native_1onInit(JNIEnv *env, jobject instance, jobject jAssetManager) {
+Java_com_cs4347_drumkit_GenerateTrackActivity_native_1onInitAsync(JNIEnv *env, jobject instance, jobject jAssetManager) {
 
     AAssetManager *assetManager = AAssetManager_fromJava(env, jAssetManager);
     if (assetManager == nullptr) {
@@ -105,8 +124,34 @@ Java_com_cs4347_drumkit_GenerateTrackActivity_native_1onInit(JNIEnv *env, jobjec
         return;
     }
 
-    dmachine = std::make_unique<DrumMachine>(*assetManager);
-    dmachine->init();
+    JavaVM *javaVm = nullptr;
+    env->GetJavaVM(&javaVm);
+    jobject activity = env->NewGlobalRef(instance);
+
+    // long samples are streamed from the APK rather than held in memory
+    auto sampleProvider = std::make_unique<AAssetSampleProvider>(
+            *assetManager, std::make_shared<SamplePrefetcher>());
+    dmachine = std::make_unique<DrumMachine>(std::move(sampleProvider),
+                                             std::make_unique<OboeAudioSink>());
+    configureTrackVoices(*dmachine);
+    // Runs on the kit loader thread, which has to be attached to the VM to call into the Activity
+    dmachine->initAsync([javaVm, activity](const KitLoadReport &report) {
+        JNIEnv *loaderEnv = nullptr;
+        if (javaVm->AttachCurrentThread(&loaderEnv, nullptr) != JNI_OK) {
+            LOGE("Could not attach the kit loader thread");
+            return;
+        }
+        jclass activityClass = loaderEnv->GetObjectClass(activity);
+        jmethodID onKitLoaded = loaderEnv->GetMethodID(activityClass, "onKitLoaded", "(ZD)V");
+        if (onKitLoaded != nullptr) {
+            loaderEnv->CallVoidMethod(activity, onKitLoaded,
+                                      static_cast<jboolean>(report.isComplete()),
+                                      static_cast<jdouble>(report.totalMillis));
+        }
+        loaderEnv->DeleteLocalRef(activityClass);
+        loaderEnv->DeleteGlobalRef(activity);
+        javaVm->DetachCurrentThread();
+    });
 }
 
 JNIEXPORT void JNICALL
@@ -122,8 +167,8 @@ Java_com_cs4347_drumkit_GenerateTrackActivity_native_1onStop(JNIEnv *env, jobjec
 
 
 JNIEXPORT void JNICALL
-Java_com_cs4347_drumkit_GenerateTrackActivity_native_1setTempo(JNIEnv *env, jobject instance, jint tempo) {
-    dmachine->setTempo(tempo);
+Java_com_cs4347_drumkit_GenerateTrackActivity_native_1setTempo(JNIEnv *env, jobject instance, jint tempo, jint rampBeats) {
+    dmachine->setTempo(tempo, rampBeats);
 }
 
 
@@ -132,6 +177,13 @@ Java_com_cs4347_drumkit_GenerateTrackActivity_native_1insertBeat(JNIEnv *env, jo
     return dmachine->insertBeat(track_idx);
 }
 
+JNIEXPORT jint JNICALL
+Java_com_cs4347_drumkit_GenerateTrackActivity_native_1insertBeatWithVelocity(JNIEnv *env, jobject instance, jint track_idx,
+                                                                            jint velocity) {
+    auto clamped = static_cast<uint8_t>(std::max(0, std::min<jint>(velocity, kMaxVelocity)));
+    return dmachine->insertBeat(track_idx, clamped);
+}
+
 JNIEXPORT void JNICALL
 Java_com_cs4347_drumkit_GenerateTrackActivity_native_1resetTrack(JNIEnv *env, jobject instance, jint track_idx) {
     dmachine->resetTrack(track_idx);
@@ -141,4 +193,59 @@ JNIEXPORT void JNICALL
 Java_com_cs4347_drumkit_GenerateTrackActivity_native_1playTrackSample(JNIEnv *env, jobject instance, jint track_idx) {
     dmachine->playTrackSample(track_idx);
 }
+
+JNIEXPORT jdouble JNICALL
+Java_com_cs4347_drumkit_GenerateTrackActivity_native_1exportWav(JNIEnv *env, jobject instance, jstring path,
+                                                               jint tempo, jint num_loops) {
+    const char *pathChars = env->GetStringUTFChars(path, nullptr);
+    OfflineRenderResult result;
+    bool isExported = dmachine->exportWav(pathChars, tempo, num_loops, &result);
+    env->ReleaseStringUTFChars(path, pathChars);
+    // speed of the render as a multiple of real time, or -1 if it failed
+    return isExported ? result.realtimeMultiple : -1.0;
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_cs4347_drumkit_GenerateTrackActivity_native_1getCallbackStats(JNIEnv *env, jobject instance) {
+    return env->NewStringUTF(dmachine->getCallbackStats().toString().c_str());
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_cs4347_drumkit_GenerateTrackActivity_native_1selectPattern(JNIEnv *env, jobject instance, jint pattern_idx) {
+    return static_cast<jboolean>(dmachine->selectPattern(pattern_idx));
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_cs4347_drumkit_GenerateTrackActivity_native_1queuePattern(JNIEnv *env, jobject instance, jint pattern_idx) {
+    return static_cast<jboolean>(dmachine->queuePattern(pattern_idx));
+}
+
+JNIEXPORT void JNICALL
+Java_com_cs4347_drumkit_GenerateTrackActivity_native_1clearPatternQueue(JNIEnv *env, jobject instance) {
+    dmachine->clearPatternQueue();
+}
+
+JNIEXPORT void JNICALL
+Java_com_cs4347_drumkit_GenerateTrackActivity_native_1setChainLooping(JNIEnv *env, jobject instance,
+                                                                     jboolean is_looping) {
+    dmachine->setChainLooping(is_looping);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_cs4347_drumkit_GenerateTrackActivity_native_1getCurrentPattern(JNIEnv *env, jobject instance) {
+    return dmachine->getCurrentPattern();
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_cs4347_drumkit_GenerateTrackActivity_native_1setGroove(JNIEnv *env, jobject instance, jint swing,
+                                                               jshortArray micro_timing) {
+    if (micro_timing == nullptr) {
+        return static_cast<jboolean>(dmachine->setGroove(swing, nullptr, 0));
+    }
+    jsize numSteps = env->GetArrayLength(micro_timing);
+    jshort *offsets = env->GetShortArrayElements(micro_timing, nullptr);
+    bool result = dmachine->setGroove(swing, offsets, numSteps);
+    env->ReleaseShortArrayElements(micro_timing, offsets, JNI_ABORT);
+    return static_cast<jboolean>(result);
+}
 }
\ No newline at end of file
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRUMMACHINE_LOCKFREEMPSCQUEUE_H
+#define DRUMMACHINE_LOCKFREEMPSCQUEUE_H
+
+#include <cstdint>
+#include <atomic>
+#include <type_traits>
+
+/**
+ * A bounded wait-free queue for multiple producers and a single consumer. Use it to post work from
+ * any number of control threads to the audio thread. See LockFreeQueue for the single producer
+ * version.
+ *
+ * Example code:
+ *
+ * LockFreeMpscQueue<Command, 64> commands;
+ * commands.push(command);   // from any thread
+ * commands.pop(command);    // from the audio thread only
+ *
+ * @tparam T - The item type, copied in and out of the queue
+ * @tparam CAPACITY - Maximum number of items which can be held in the queue. Must be a power of 2.
+ */
+template <typename T, uint32_t CAPACITY>
+class LockFreeMpscQueue {
+public:
+
+    /**
+     * Implementation details:
+     *
+     * A producer first takes one of freeSlots, which the consumer gives back as it pops, and then
+     * claims the next position with a fetch_add on writeCounter. Holding a free slot guarantees
+     * that the consumer is done with the slot at that position, so neither step ever retries: a
+     * push finishes in a fixed number of steps however many threads race it, and it never blocks
+     * or allocates. A slot's sequence is set to position + 1 once its item is written, which
+     * tells the consumer the item is ready. The consumer owns readCounter and pops without any
+     * retry loop. A producer which is preempted between claiming a position and writing its item
+     * holds back the items behind it until it resumes, pop reports the queue as empty meanwhile.
+     * A push which finds the queue full gives its slot back, a push racing it for the last free
+     * slot may then report the queue as full too.
+     *
+     * Counters wrap around at UINT32_MAX, CAPACITY divides 2^32 so positions keep their slots.
+     */
+
+    static constexpr bool isPowerOfTwo(uint32_t n) { return (n & (n - 1)) == 0; }
+    static_assert(isPowerOfTwo(CAPACITY), "Capacity must be a power of 2");
+
+    LockFreeMpscQueue() {
+        for (uint32_t i = 0; i < CAPACITY; ++i) {
+            buffer[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Add an item to the back of the queue. Safe to call from any number of threads.
+     *
+     * @param item - The item to add
+     * @return true if item was added, false if the queue was full
+     */
+    bool push(const T& item) {
+        // acquire pairs with pop giving a slot back, after it has copied the item out
+        if (freeSlots.fetch_sub(1, std::memory_order_acquire) <= 0) {
+            freeSlots.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        // The slot given back may have been the one of a producer which claims an earlier
+        // position, so the claims pass it on from producer to producer
+        uint32_t position = writeCounter.fetch_add(1, std::memory_order_acq_rel);
+        Slot &slot = buffer[mask(position)];
+        slot.item = item;
+        slot.sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Pop a value off the head of the queue. Must only be called from the consumer thread.
+     *
+     * @param val - element will be stored in this variable
+     * @return true if value was popped successfully, false if the queue is empty
+     */
+    bool pop(T &val) {
+        Slot &slot = buffer[mask(readCounter)];
+        if (slot.sequence.load(std::memory_order_acquire) != readCounter + 1) {
+            return false;
+        }
+        val = slot.item;
+        ++readCounter;
+        freeSlots.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+private:
+
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        T item;
+    };
+
+    uint32_t mask(uint32_t n) const { return n & (CAPACITY - 1); }
+
+    Slot buffer[CAPACITY];
+    std::atomic<int32_t> freeSlots { static_cast<int32_t>(CAPACITY) };
+    std::atomic<uint32_t> writeCounter { 0 };
+    uint32_t readCounter = 0;
+};
+
+#endif //DRUMMACHINE_LOCKFREEMPSCQUEUE_H
@@ -18,15 +18,43 @@
 #define ANDROID_LOGGING_H
 
 #include <stdio.h>
-#include <android/log.h>
 #include <vector>
 
 #define APP_NAME "RhythmGame"
+
+#ifdef __ANDROID__
+
+#include <android/log.h>
+
 #define LOGD(...) ((void)__android_log_print(ANDROID_LOG_DEBUG, APP_NAME, __VA_ARGS__))
 #define LOGI(...) ((void)__android_log_print(ANDROID_LOG_INFO, APP_NAME, __VA_ARGS__))
 #define LOGW(...) ((void)__android_log_print(ANDROID_LOG_WARN, APP_NAME, __VA_ARGS__))
 #define LOGE(...) ((void)__android_log_print(ANDROID_LOG_ERROR, APP_NAME, __VA_ARGS__))
 
+#else
+
+#include <stdarg.h>
+
+// Host builds log to stderr in logcat's brief format, e.g. "W/RhythmGame: ...". Each message is
+// written with a single call so that messages from different threads don't interleave.
+__attribute__((format(printf, 2, 3)))
+inline void hostLogPrint(char level, const char *format, ...) {
+    char message[1024];
+    int prefixLength = snprintf(message, sizeof(message), "%c/" APP_NAME ": ", level);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message + prefixLength, sizeof(message) - prefixLength - 1, format, args);
+    va_end(args);
+    fprintf(stderr, "%s\n", message);
+}
+
+#define LOGD(...) hostLogPrint('D', __VA_ARGS__)
+#define LOGI(...) hostLogPrint('I', __VA_ARGS__)
+#define LOGW(...) hostLogPrint('W', __VA_ARGS__)
+#define LOGE(...) hostLogPrint('E', __VA_ARGS__)
+
+#endif
+
 
 
 #endif //ANDROID_LOGGING_H
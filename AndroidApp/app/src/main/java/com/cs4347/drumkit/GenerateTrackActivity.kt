@@ -18,6 +18,7 @@ import io.reactivex.schedulers.Schedulers
 import io.reactivex.subjects.CompletableSubject
 import kotlinx.android.synthetic.main.activity_generate_track.*
 import kotlinx.android.synthetic.main.view_instrument_row.view.*
+import java.io.File
 import java.util.concurrent.TimeUnit
 import android.view.animation.DecelerateInterpolator
 import android.animation.ObjectAnimator
@@ -33,13 +34,22 @@ import kotlin.math.*
 
 
 class GenerateTrackActivity : Activity() {
-    private external fun native_onInit(assetManager: AssetManager)
+    private external fun native_onInitAsync(assetManager: AssetManager)
     private external fun native_onStart(tempo: Int, beatIdx: Int)
     private external fun native_onStop()
     private external fun native_insertBeat(channel_idx: Int): Int
-    private external fun native_setTempo(tempo: Int)
+    private external fun native_insertBeatWithVelocity(channel_idx: Int, velocity: Int): Int
+    private external fun native_setTempo(tempo: Int, rampBeats: Int)
     private external fun native_resetTrack(track_idx: Int)
     private external fun native_playTrackSample(track_idx: Int)
+    private external fun native_exportWav(path: String, tempo: Int, num_loops: Int): Double
+    private external fun native_selectPattern(pattern_idx: Int): Boolean
+    private external fun native_queuePattern(pattern_idx: Int): Boolean
+    private external fun native_clearPatternQueue()
+    private external fun native_setChainLooping(is_looping: Boolean)
+    private external fun native_getCurrentPattern(): Int
+    private external fun native_getCallbackStats(): String
+    private external fun native_setGroove(swing: Int, micro_timing: ShortArray?): Boolean
 
     init
     {
@@ -47,8 +57,18 @@ class GenerateTrackActivity : Activity() {
     }
 
     companion object {
+        private const val TAG = "GenerateTrackActivity"
         private val tempoRange = Pair(60, 120)
         private const val tempoStep = 10
+        private const val tempoRampBeats = 1
+        // swing settings the swing button steps through, 50% is straight time
+        private val swingSettings = listOf(50, 58, 67, 75)
+        // patterns A to D can be edited and chained into a song
+        private const val numPatterns = 4
+        // loops of the current pattern in an exported bounce
+        private const val exportLoops = 4
+        // velocity range of gesture hits, the softest gesture still has to be audible
+        private val velocityRange = Pair(32, 127)
         // currently an arbitrary value, ensure it is between 1000/(24 to 120Hz), standard refresh rate
         private const val seekBarUpdatePeriod = 16L
         private const val seekBarSnapDuration = 200L
@@ -64,15 +84,24 @@ class GenerateTrackActivity : Activity() {
             "Scratch" to R.color.colorScratch,
             "Rim" to R.color.colorRim
     )
+    // beats of the patterns which aren't being edited, the grid only shows the edited one
+    private val patternBeats = Array(numPatterns) {
+        Array(instruments.size) { BooleanArray(DrumKitInstrumentsAdapter.COLUMNS) }
+    }
     private val disposables: CompositeDisposable = CompositeDisposable()
     private val gestureRecognizer: GestureRecognizer by lazy { GestureRecognizer(this) }
 
     private lateinit var instrumentsAdapter: DrumKitInstrumentsAdapter
     private var tempo = tempoRange.first
+    private var swingIdx = 0
+    private var editPatternIdx = 0
+    private var chainLooping = false
     private var selectedInstrumentRow: Int? = null
     private var experimentalMode: Boolean = false
 
     private var seekBarMovementDisposable: Disposable? = null
+    // tempo the seek bar is currently moving at, it lags behind tempo during a ramp
+    private var seekBarTempo = tempo.toFloat()
     private var sensorDataDisposable: Disposable? = null
 
     private fun hideNavBar() {
@@ -145,14 +174,64 @@ class GenerateTrackActivity : Activity() {
 
         tempoUp.setOnClickListener {
             tempo = min(tempoRange.second, tempo + tempoStep)
-            setTempoText()
-            gestureRecognizer.updateBeatCoolDown(tempo)
+            onTempoChanged()
         }
 
         tempoDown.setOnClickListener {
             tempo = max(tempoRange.first, tempo - tempoStep)
-            setTempoText()
-            gestureRecognizer.updateBeatCoolDown(tempo)
+            onTempoChanged()
+        }
+
+        swing.setOnClickListener {
+            // the drum machine switches grooves at the start of the next loop, without stopping
+            val nextIdx = (swingIdx + 1) % swingSettings.size
+            if (native_setGroove(swingSettings[nextIdx], null)) {
+                swingIdx = nextIdx
+                setSwingText()
+            }
+        }
+
+        pattern.setOnClickListener {
+            // the pattern being edited keeps playing its part of the song
+            val nextIdx = (editPatternIdx + 1) % numPatterns
+            if (native_selectPattern(nextIdx)) {
+                for (row in instruments.indices) {
+                    patternBeats[editPatternIdx][row] = beatsAdapterOf(row).getColumns()
+                    beatsAdapterOf(row).setColumns(patternBeats[nextIdx][row])
+                }
+                editPatternIdx = nextIdx
+                setPatternText()
+            }
+        }
+
+        queue_pattern.setOnClickListener {
+            val text = when (native_queuePattern(editPatternIdx)) {
+                true -> "Pattern ${patternName(editPatternIdx)} queued, " +
+                        "${patternName(native_getCurrentPattern())} playing"
+                false -> "The song is full"
+            }
+            Toast.makeText(this@GenerateTrackActivity, text, Toast.LENGTH_SHORT).show()
+        }
+
+        clear_queue.setOnClickListener {
+            native_clearPatternQueue()
+            Toast.makeText(this@GenerateTrackActivity,
+                    "Song cleared, ${patternName(native_getCurrentPattern())} keeps playing",
+                    Toast.LENGTH_SHORT).show()
+        }
+
+        chain.setOnClickListener {
+            chainLooping = !chainLooping
+            native_setChainLooping(chainLooping)
+            val onOffText = when (chainLooping) {
+                true -> "ON"
+                false -> "OFF"
+            }
+            chain.text = "Chain ($onOffText)"
+        }
+
+        export.setOnClickListener {
+            exportBounce()
         }
 
         play.setOnClickListener {
@@ -179,7 +258,9 @@ class GenerateTrackActivity : Activity() {
                                 .subscribeOn(AndroidSchedulers.mainThread())
                                 .subscribe { _, _ ->
                                     // casting is safe here, a track is always selected after play()
-                                    val beatIdx = native_insertBeat(selectedInstrumentRow!!)
+                                    val velocity = velocityRange.first + (gesture.intensity *
+                                            (velocityRange.second - velocityRange.first)).roundToInt()
+                                    val beatIdx = native_insertBeatWithVelocity(selectedInstrumentRow!!, velocity)
                                     setSelectedInstrumentBeat(beatIdx, true)
                                 }
                     }
@@ -250,15 +331,37 @@ class GenerateTrackActivity : Activity() {
         }
 
         setTempoText()
+        setSwingText()
+        setPatternText()
         setButtons(false)
+        // enabled by onKitLoaded
+        play.isEnabled = false
+        record.isEnabled = false
 
         // try to make seekbar range a multiple of our update frequency (big enough should be fine)
         // there is no particularly good reason for using the existing combination
         drumkit_instruments.seekBar.max =
                 60 * 10 * tempo * DrumKitInstrumentsAdapter.COLUMNS * seekBarUpdatePeriod.toInt()
 
-        // initialise DrumMachine
-        native_onInit(assets)
+        // initialise DrumMachine, the kit is loaded in the background
+        native_onInitAsync(assets)
+    }
+
+    /**
+     * Called from native code on the kit loader thread once the samples are ready
+     */
+    @Suppress("unused")
+    fun onKitLoaded(isLoaded: Boolean, loadMillis: Double) {
+        Log.i(TAG, "Drum kit loaded in $loadMillis ms")
+        runOnUiThread {
+            if (isLoaded) {
+                setButtons(false)
+            } else {
+                Toast.makeText(this@GenerateTrackActivity,
+                        "Could not load the drum kit",
+                        Toast.LENGTH_LONG).show()
+            }
+        }
     }
 
     private fun debugModeOnCreate() {
@@ -314,6 +417,7 @@ class GenerateTrackActivity : Activity() {
         seekBarMovementDisposable?.dispose()
         sensorDataDisposable?.dispose()
         native_onStop()
+        Log.i(TAG, "Audio callback stats: ${native_getCallbackStats()}")
     }
 
     override fun onStop() {
@@ -322,6 +426,29 @@ class GenerateTrackActivity : Activity() {
         super.onStop()
     }
 
+    /**
+     * Renders exportLoops loops of the current pattern to a WAV file, faster than real time on a
+     * background thread. The drum machine has to stay stopped until it is done.
+     */
+    private fun exportBounce() {
+        val dir = getExternalFilesDir(null) ?: filesDir
+        val file = File(dir, "bounce_${System.currentTimeMillis()}.wav")
+        play.isEnabled = false
+        record.isEnabled = false
+        export.isEnabled = false
+        disposables.add(Single.fromCallable { native_exportWav(file.path, tempo, exportLoops) }
+                .subscribeOn(Schedulers.io())
+                .observeOn(AndroidSchedulers.mainThread())
+                .subscribe { realtimeMultiple, _ ->
+                    setButtons(false)
+                    val text = when (realtimeMultiple != null && realtimeMultiple >= 0) {
+                        true -> "Exported to ${file.path} at %.0fx real time".format(realtimeMultiple)
+                        false -> "Could not export the pattern"
+                    }
+                    Toast.makeText(this@GenerateTrackActivity, text, Toast.LENGTH_LONG).show()
+                })
+    }
+
     private fun setSelectedInstrumentBeat(col: Int, activate: Boolean) {
         selectedInstrumentRow?.let {
             val beatRowRecycler: RecyclerView = drumkit_instruments.instrumentsRecycler.getChildAt(it).instrument_beats_rv
@@ -338,12 +465,16 @@ class GenerateTrackActivity : Activity() {
         }
     }
 
+    private fun beatsAdapterOf(row: Int): BeatsAdapter {
+        val beatRowRecycler: RecyclerView = drumkit_instruments.instrumentsRecycler.getChildAt(row).instrument_beats_rv
+        return beatRowRecycler.adapter as BeatsAdapter
+    }
+
     private fun setButtons(playingBack: Boolean) {
         play.isEnabled = !playingBack
         record.isEnabled = !playingBack
-        tempoUp.isEnabled = !playingBack
-        tempoDown.isEnabled = !playingBack
         clear.isEnabled = !playingBack
+        export.isEnabled = !playingBack
 
         pause.isEnabled = playingBack
     }
@@ -386,16 +517,21 @@ class GenerateTrackActivity : Activity() {
                 })
     }
 
-    private fun startSeekBarMovement() {
-        val timePerBeatMs = 60*1000/tempo.toFloat()
-        val totalDuration: Float = timePerBeatMs * DrumKitInstrumentsAdapter.COLUMNS
-        val timePerPercentage: Float = totalDuration / drumkit_instruments.seekBar.max
-        val percentagePerTime: Float = 1/timePerPercentage
+    /**
+     * Moves the seek bar along with the playhead. After a tempo change the rate glides from
+     * rampFromTempo to tempo over tempoRampBeats, following the same linear ramp as the drum machine.
+     */
+    private fun startSeekBarMovement(rampFromTempo: Float = tempo.toFloat()) {
+        val progressPerBeat: Float =
+                drumkit_instruments.seekBar.max.toFloat() / DrumKitInstrumentsAdapter.COLUMNS
 
-        var prevPosition = drumkit_instruments.seekBar.progress
+        var prevPosition = drumkit_instruments.seekBar.progress.toFloat()
 
         var prevTime = System.currentTimeMillis()
 
+        var rampBeatsLeft = if (rampFromTempo != tempo.toFloat()) tempoRampBeats.toFloat() else 0f
+        seekBarTempo = rampFromTempo
+
         seekBarMovementDisposable =
                 Observable.interval(seekBarUpdatePeriod, TimeUnit.MILLISECONDS)
                         .subscribeOn(Schedulers.computation())
@@ -403,10 +539,14 @@ class GenerateTrackActivity : Activity() {
                         .subscribe {
                             val newTime = System.currentTimeMillis()
                             val timePassedMs = newTime - prevTime
-                            val newPosition =
-                                    (prevPosition + percentagePerTime*timePassedMs).roundToInt() %
-                                            (drumkit_instruments.seekBar.max + 1)
-                            drumkit_instruments.seekBar.progress = newPosition
+                            val beatsPassed = seekBarTempo * timePassedMs / (60 * 1000)
+                            if (rampBeatsLeft > 0) {
+                                rampBeatsLeft = max(0f, rampBeatsLeft - beatsPassed)
+                                seekBarTempo = tempo + (rampFromTempo - tempo) * rampBeatsLeft / tempoRampBeats
+                            }
+                            val newPosition = (prevPosition + progressPerBeat*beatsPassed) %
+                                    (drumkit_instruments.seekBar.max + 1)
+                            drumkit_instruments.seekBar.progress = newPosition.roundToInt()
 
                             prevPosition = newPosition
                             prevTime = newTime
@@ -417,10 +557,33 @@ class GenerateTrackActivity : Activity() {
         }
     }
 
+    private fun onTempoChanged() {
+        setTempoText()
+        gestureRecognizer.updateBeatCoolDown(tempo)
+        // the drum machine glides to the new tempo without stopping, ramp the seek bar along with it
+        native_setTempo(tempo, tempoRampBeats)
+        seekBarMovementDisposable?.takeIf { !it.isDisposed }?.let {
+            disposables.remove(it)
+            startSeekBarMovement(seekBarTempo)
+        }
+    }
+
     private fun setTempoText() {
         tempoText.text = resources.getString(R.string.tempo_display, tempo)
     }
 
+    private fun patternName(patternIdx: Int): String {
+        return ('A' + patternIdx).toString()
+    }
+
+    private fun setPatternText() {
+        pattern.text = resources.getString(R.string.pattern_display, patternName(editPatternIdx))
+    }
+
+    private fun setSwingText() {
+        swing.text = resources.getString(R.string.swing_display, swingSettings[swingIdx])
+    }
+
 }
 
 /**
@@ -12,7 +12,8 @@ import android.app.Activity
 
 
 enum class GestureType {NO_GESTURE, DOWN, UP, LEFT, RIGHT}
-data class Gesture(val type: GestureType, val time: Long)
+// intensity is how hard the gesture was, from 0 to 1
+data class Gesture(val type: GestureType, val time: Long, val intensity: Float = 1f)
 
 interface Model {
     /**
@@ -42,6 +43,7 @@ class GestureRecognizer(activity: Activity,
         const val DATA_ITEMS_PER_MSG = 3 // 3 axes
         const val MODEL_INPUT_SIZE = NUM_SENSORS * WINDOW_SIZE * DATA_ITEMS_PER_MSG
         const val MESSAGE_PERIOD = 5 // 5ms between each message item
+        const val FULL_INTENSITY_ACCELERATION = 30f // m/s^2, peak acceleration of the hardest hit
     }
 
     private val accelerationWindow: LinkedList<SensorMessage> = LinkedList()
@@ -132,9 +134,13 @@ class GestureRecognizer(activity: Activity,
                         }
                     }
                     val gestureTime = accelerationWindow.first.timestamp
+                    val intensity = when (gestureType) {
+                        GestureType.NO_GESTURE -> 0f
+                        else -> gestureIntensity()
+                    }
                     accelerationWindow.removeFirst()
                     gyroscopeWindow.removeFirst()
-                    listener(Gesture(gestureType, gestureTime))
+                    listener(Gesture(gestureType, gestureTime, intensity))
                 }
                 .apply {
                     compositeDisposable.add(this)
@@ -192,6 +198,17 @@ class GestureRecognizer(activity: Activity,
         return hasSufficientData
     }
 
+    /**
+     * Peak acceleration in the current window, scaled to [0, 1]
+     */
+    private fun gestureIntensity(): Float {
+        val peak = accelerationWindow.map { message ->
+            val data = message.dataList
+            Math.sqrt(data.sumByDouble { (it * it).toDouble() }).toFloat()
+        }.max() ?: 0f
+        return Math.min(peak / FULL_INTENSITY_ACCELERATION, 1f)
+    }
+
     // debugging code
     private var predictCountDebug = 0
     // 2 * 1000ms / MESSAGE_PERIOD, a gesture every 2s
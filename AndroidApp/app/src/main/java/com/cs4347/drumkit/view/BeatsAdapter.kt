@@ -46,6 +46,15 @@ class BeatsAdapter(private val numBeats: Int): RecyclerView.Adapter<BeatViewHold
         notifyItemChanged(col)
     }
 
+    fun getColumns(): BooleanArray {
+        return selectedCols.copyOf()
+    }
+
+    fun setColumns(cols: BooleanArray) {
+        selectedCols = cols.copyOf()
+        notifyDataSetChanged()
+    }
+
     fun clearAll() {
         selectedCols = BooleanArray(numBeats)
         notifyDataSetChanged()
@@ -0,0 +1,322 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Benchmarks for the audio hot paths: Player::renderAudio, Mixer::renderAudio,
+ * DrumMachine::onRenderAudio (the audio callback), DrumMachine::refreshLoop, the callback
+ * telemetry and IMA ADPCM decoding.
+ *
+ * Each render is swept over burst sizes from 32 to 1920 frames, and over the number of sounding
+ * voices or the density of the pattern. Results are in ns per output frame, next to the share of
+ * the real-time budget at 48kHz (20833 ns per frame) that they use. The samples are synthetic, so
+ * the figures don't depend on the kit. Built by the host CMake build, e.g.
+ *
+ * > cmake -S . -B build && cmake --build build && build/drummachine_benchmark
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "DrumMachine.h"
+#include "audio/ImaAdpcm.h"
+#include "audio/Mixer.h"
+#include "audio/Player.h"
+#include "audio/WavDecoder.h"
+
+constexpr int32_t kBurstSizes[] = {32, 64, 128, 192, 256, 480, 960, 1920};
+constexpr int32_t kSampleFrames = kDefaultSampleRateHz * 2; // long enough for any hit to still ring out
+constexpr int64_t kFramesPerRun = kDefaultSampleRateHz * 20; // audio rendered per measurement
+constexpr int kRefreshLoopCalls = 1000000;
+constexpr double kNsPerFrameBudget = 1e9 / kDefaultSampleRateHz;
+constexpr int32_t kAdpcmBlockAlign = 2048; // what common encoders use for stereo at 48kHz
+
+/**
+ * A decaying noise burst, loud enough that the limiter has to work when many voices sound
+ */
+class SyntheticDataSource : public DataSource {
+public:
+    explicit SyntheticDataSource(uint32_t seed) : mBuffer(kSampleFrames * kChannelCount) {
+        for (int32_t i = 0; i < kSampleFrames; i++) {
+            float envelope = 1.0f - static_cast<float>(i) / kSampleFrames;
+            for (int32_t c = 0; c < kChannelCount; c++) {
+                seed = seed * 1664525u + 1013904223u;
+                mBuffer[i * kChannelCount + c] = static_cast<int16_t>(
+                        static_cast<int16_t>(seed >> 16) * envelope);
+            }
+        }
+    }
+
+    int32_t getTotalFrames() const override { return kSampleFrames; }
+    int32_t getChannelCount() const override { return kChannelCount; }
+    const int16_t* getData() const override { return mBuffer.data(); }
+
+private:
+    std::vector<int16_t> mBuffer;
+};
+
+class SyntheticSampleProvider : public SampleProvider {
+public:
+    std::shared_ptr<DataSource> loadSample(const std::string &, int32_t, int32_t) override {
+        return std::make_shared<SyntheticDataSource>(mSeed++);
+    }
+
+private:
+    std::atomic<uint32_t> mSeed { 4347 }; // samples are loaded concurrently
+};
+
+/**
+ * Never calls back by itself, the benchmark drives the callback directly
+ */
+class ManualAudioSink : public AudioSink {
+public:
+    bool start(AudioSinkCallback *, int32_t, int32_t) override { mIsRunning = true; return true; }
+    void stop() override { mIsRunning = false; }
+    bool isRunning() const override { return mIsRunning; }
+    int32_t getNativeSampleRate() override { return kDefaultSampleRateHz; }
+
+private:
+    bool mIsRunning = false;
+};
+
+/**
+ * Time render(numFrames) over kFramesPerRun frames of audio
+ *
+ * @return ns per output frame
+ */
+template <typename Render>
+static double measureNsPerFrame(int32_t burstSize, Render render) {
+    // warm up caches and the branch predictor
+    for (int64_t frame = 0; frame < kDefaultSampleRateHz; frame += burstSize) {
+        render(burstSize);
+    }
+    auto start = std::chrono::steady_clock::now();
+    int64_t framesRendered = 0;
+    while (framesRendered < kFramesPerRun) {
+        render(burstSize);
+        framesRendered += burstSize;
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return ns / framesRendered;
+}
+
+static void printHeader(const char *title, const char *sweepName) {
+    printf("\n%s\n%8s %8s %12s %10s\n", title, sweepName, "burst", "ns/frame", "budget %");
+}
+
+static void printResult(int sweepValue, int32_t burstSize, double nsPerFrame) {
+    printf("%8d %8d %12.2f %10.3f\n", sweepValue, burstSize, nsPerFrame,
+           100.0 * nsPerFrame / kNsPerFrameBudget);
+}
+
+/**
+ * Start numVoices looping voices on a player, a render apart so that no trigger is coalesced
+ */
+static void startVoices(Player &player, int numVoices) {
+    int16_t frame[kChannelCount];
+    player.setPlaying(false);
+    player.renderAudio(frame, 1);
+    player.setLooping(true);
+    for (int v = 0; v < numVoices; v++) {
+        player.trigger();
+        player.renderAudio(frame, 1);
+    }
+}
+
+static void benchmarkPlayer() {
+    constexpr int kVoiceCounts[] = {1, 2, 4, 8, 16};
+    printHeader("Player::renderAudio, int16_t output", "voices");
+    std::vector<int16_t> output(kMaxFramesPerRender * 2 * kChannelCount);
+    for (int numVoices : kVoiceCounts) {
+        Player player(std::make_shared<SyntheticDataSource>(1), numVoices);
+        startVoices(player, numVoices);
+        for (int32_t burstSize : kBurstSizes) {
+            printResult(numVoices, burstSize, measureNsPerFrame(burstSize, [&](int32_t numFrames) {
+                player.renderAudio(output.data(), numFrames);
+            }));
+        }
+    }
+}
+
+static void benchmarkMixer() {
+    constexpr int kTrackCounts[] = {1, 4, 9, 16, 32, 64};
+    printHeader("Mixer::renderAudio, float output, one voice per track", "tracks");
+    std::vector<float> output(kBurstSizes[sizeof(kBurstSizes) / sizeof(kBurstSizes[0]) - 1] * kChannelCount);
+    for (int numTracks : kTrackCounts) {
+        Mixer mixer;
+        std::vector<std::shared_ptr<Player>> players;
+        for (int t = 0; t < numTracks; t++) {
+            players.push_back(std::make_shared<Player>(std::make_shared<SyntheticDataSource>(t), 1));
+            startVoices(*players.back(), 1);
+            mixer.addTrack(players.back());
+            mixer.activateTrack(static_cast<uint8_t>(t));
+        }
+        for (int32_t burstSize : kBurstSizes) {
+            printResult(numTracks, burstSize, measureNsPerFrame(burstSize, [&](int32_t numFrames) {
+                // the mixer takes at most kMaxFramesPerRender frames at a time, like renderFrames
+                for (int32_t frame = 0; frame < numFrames; frame += kMaxFramesPerRender) {
+                    mixer.renderAudio(output.data() + frame * kChannelCount,
+                                      std::min(kMaxFramesPerRender, numFrames - frame));
+                }
+            }));
+        }
+    }
+}
+
+/**
+ * Fill a 16 step, 8 track pattern of sixteenth notes to the given density, spreading the hits out
+ * evenly over the steps and tracks
+ */
+static void programPattern(DrumMachine &drumMachine, int densityPercent) {
+    constexpr int kNumSteps = 16;
+    drumMachine.resetAll();
+    drumMachine.setPatternGeometry(kNumSteps, 4, kDefaultNumPatternTracks);
+    int numCells = kNumSteps * kDefaultNumPatternTracks;
+    int numHits = numCells * densityPercent / 100;
+    for (int hit = 0; hit < numHits; hit++) {
+        int cell = hit * numCells / numHits;
+        drumMachine.addBeat(cell % kDefaultNumPatternTracks, cell / kDefaultNumPatternTracks);
+    }
+}
+
+class DrumMachineBenchmark {
+public:
+    DrumMachineBenchmark()
+            : mDrumMachine(std::make_unique<SyntheticSampleProvider>(),
+                           std::make_unique<ManualAudioSink>()) {
+        mDrumMachine.init();
+    }
+
+    void benchmarkCallback() {
+        constexpr int kDensities[] = {0, 25, 50, 100};
+        printHeader("DrumMachine::onRenderAudio, float output, 120 bpm sixteenths", "density%");
+        std::vector<float> output(kBurstSizes[sizeof(kBurstSizes) / sizeof(kBurstSizes[0]) - 1] * kChannelCount);
+        for (int density : kDensities) {
+            programPattern(mDrumMachine, density);
+            mDrumMachine.start(120, 0);
+            for (int32_t burstSize : kBurstSizes) {
+                printResult(density, burstSize, measureNsPerFrame(burstSize, [&](int32_t numFrames) {
+                    mDrumMachine.onRenderAudio(output.data(), true, numFrames);
+                }));
+            }
+            mDrumMachine.stop();
+        }
+    }
+
+    /**
+     * refreshLoop runs once per loop on the audio thread: keeping the current schedule, and
+     * switching to the next pattern of the song
+     */
+    void benchmarkRefreshLoop() {
+        printf("\nDrumMachine::refreshLoop\n%24s %12s\n", "case", "ns/call");
+        programPattern(mDrumMachine, 50);
+        mDrumMachine.start(120, 0);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kRefreshLoopCalls; i++) {
+            mDrumMachine.refreshLoop();
+        }
+        printf("%24s %12.2f\n", "same pattern", nsPerCall(start));
+
+        mDrumMachine.setChainLooping(true);
+        mDrumMachine.queuePattern(0);
+        mDrumMachine.queuePattern(1);
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kRefreshLoopCalls; i++) {
+            mDrumMachine.refreshLoop();
+        }
+        printf("%24s %12.2f\n", "looping chain of 2", nsPerCall(start));
+        mDrumMachine.setChainLooping(false);
+        mDrumMachine.clearPatternQueue();
+        mDrumMachine.stop();
+    }
+
+private:
+    static double nsPerCall(std::chrono::steady_clock::time_point start) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double, std::nano>(elapsed).count() / kRefreshLoopCalls;
+    }
+
+    DrumMachine mDrumMachine;
+};
+
+/**
+ * Cost of timing a callback, which DrumMachine::onRenderAudio does on every callback
+ */
+static void benchmarkTelemetry() {
+    CallbackTelemetry telemetry;
+    telemetry.reset(kDefaultSampleRateHz);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRefreshLoopCalls; i++) {
+        auto callbackStart = std::chrono::steady_clock::now();
+        auto duration = std::chrono::steady_clock::now() - callbackStart;
+        telemetry.record(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 192, 0);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    printf("\nCallbackTelemetry, two clock reads and record()\n%12.2f ns per callback\n",
+           ns / kRefreshLoopCalls);
+}
+
+/**
+ * Decode throughput of IMA ADPCM, which streamed ADPCM samples pay on the prefetch thread. Any
+ * nibbles are valid ADPCM, so the blocks are just noise.
+ */
+static void benchmarkAdpcmDecode() {
+    WavInfo info;
+    info.sampleRate = kDefaultSampleRateHz;
+    info.channelCount = kChannelCount;
+    info.bitsPerSample = 4;
+    info.isAdpcm = true;
+    info.blockAlign = kAdpcmBlockAlign;
+    info.framesPerBlock = ImaAdpcm::framesPerBlock(kAdpcmBlockAlign, kChannelCount);
+    info.numFrames = kSampleFrames;
+
+    size_t numBlocks = (kSampleFrames + info.framesPerBlock - 1) / info.framesPerBlock;
+    std::vector<uint8_t> blocks(numBlocks * kAdpcmBlockAlign);
+    uint32_t seed = 4347;
+    for (uint8_t &byte : blocks) {
+        seed = seed * 1664525u + 1013904223u;
+        byte = static_cast<uint8_t>(seed >> 24);
+    }
+
+    std::vector<int16_t> decoded(static_cast<size_t>(kSampleFrames) * kChannelCount);
+    auto start = std::chrono::steady_clock::now();
+    int64_t framesDecoded = 0;
+    while (framesDecoded < kFramesPerRun) {
+        WavDecoder::decodeAdpcm(blocks.data(), blocks.size(), info, 0, kSampleFrames, decoded.data());
+        framesDecoded += kSampleFrames;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double nsPerFrame = seconds * 1e9 / framesDecoded;
+    printf("\nIMA ADPCM decode, %d byte blocks\n%12.2f ns/frame %10.1f MB/s of PCM %10.0fx real time\n",
+           kAdpcmBlockAlign, nsPerFrame, framesDecoded * kChannelCount * sizeof(int16_t) / seconds / 1e6,
+           kNsPerFrameBudget / nsPerFrame);
+}
+
+int main() {
+    printf("real-time budget at %d Hz: %.0f ns per frame\n", kDefaultSampleRateHz, kNsPerFrameBudget);
+    benchmarkPlayer();
+    benchmarkMixer();
+    DrumMachineBenchmark drumMachineBenchmark;
+    drumMachineBenchmark.benchmarkCallback();
+    drumMachineBenchmark.benchmarkRefreshLoop();
+    benchmarkTelemetry();
+    benchmarkAdpcmDecode();
+    return 0;
+}
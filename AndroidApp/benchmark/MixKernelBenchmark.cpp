@@ -0,0 +1,103 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Microbenchmark for the mix kernel used by Mixer::renderAudio.
+ *
+ * Mixes 1-64 active tracks into one output block and reports the cost in ns per output frame,
+ * next to the plain wrapping int16_t `+=` loop the mixer originally used. The float bus figure
+ * includes the final soft limiter and conversion to int16_t. Built by the host CMake build as
+ * mix_kernel_benchmark, or by hand for a device shell, e.g.
+ *
+ * > c++ -std=c++14 -O2 -I../app/src/main/cpp MixKernelBenchmark.cpp -o mix_kernel_benchmark
+ * > ./mix_kernel_benchmark
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "audio/MixKernel.h"
+
+constexpr int32_t kChannelCount = 2;
+constexpr int32_t kFramesPerBlock = 192;
+constexpr int32_t kSamplesPerBlock = kFramesPerBlock * kChannelCount;
+constexpr int kMaxTracks = 64;
+constexpr int kBlocksPerRun = 20000;
+
+template <typename MixFunction, typename OutputFunction>
+static double measureNsPerFrame(MixFunction mix, OutputFunction output,
+                                const std::vector<std::vector<int16_t>> &tracks, int numTracks,
+                                int64_t &checksum) {
+    std::vector<float> mixBus(kSamplesPerBlock);
+    std::vector<int16_t> wrappingBus(kSamplesPerBlock);
+    std::vector<int16_t> outputBlock(kSamplesPerBlock);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int block = 0; block < kBlocksPerRun; ++block) {
+        for (int32_t j = 0; j < kSamplesPerBlock; ++j) {
+            mixBus[j] = 0;
+            wrappingBus[j] = 0;
+        }
+        for (int t = 0; t < numTracks; ++t) {
+            mix(mixBus.data(), wrappingBus.data(), tracks[t].data());
+        }
+        output(outputBlock.data(), mixBus.data(), wrappingBus.data());
+        checksum += outputBlock[block % kSamplesPerBlock];
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double totalNs = std::chrono::duration<double, std::nano>(elapsed).count();
+    return totalNs / (static_cast<double>(kBlocksPerRun) * kFramesPerBlock);
+}
+
+int main() {
+    // loud, uncorrelated content so that the limiter actually has to work
+    std::vector<std::vector<int16_t>> tracks(kMaxTracks, std::vector<int16_t>(kSamplesPerBlock));
+    uint32_t seed = 4347;
+    for (auto &track : tracks) {
+        for (auto &sample : track) {
+            seed = seed * 1664525u + 1013904223u;
+            sample = static_cast<int16_t>(seed >> 16);
+        }
+    }
+
+    int64_t checksum = 0;
+    printf("mix kernel: %s, %d frames per block\n", kMixKernelName, kFramesPerBlock);
+    printf("%8s %16s %16s\n", "tracks", "wrapping ns/fr", "float bus ns/fr");
+    for (int numTracks = 1; numTracks <= kMaxTracks; numTracks *= 2) {
+        double wrapping = measureNsPerFrame(
+                [](float *, int16_t *target, const int16_t *source) {
+                    for (int32_t i = 0; i < kSamplesPerBlock; ++i) target[i] += source[i];
+                },
+                [](int16_t *target, const float *, const int16_t *source) {
+                    for (int32_t i = 0; i < kSamplesPerBlock; ++i) target[i] = source[i];
+                },
+                tracks, numTracks, checksum);
+        double floatBus = measureNsPerFrame(
+                [](float *mixBus, int16_t *, const int16_t *source) {
+                    mixToBus(mixBus, source, kSamplesPerBlock);
+                },
+                [](int16_t *target, const float *mixBus, const int16_t *) {
+                    limitToI16(target, mixBus, kSamplesPerBlock);
+                },
+                tracks, numTracks, checksum);
+        printf("%8d %16.3f %16.3f\n", numTracks, wrapping, floatBus);
+    }
+    printf("checksum %lld\n", static_cast<long long>(checksum));
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Runs the drum machine engine on the host, without a device or an audio stream.
+ *
+ * Loads the kit from a directory, programs a demo pattern and either renders it offline as fast
+ * as possible, or plays it live through the null audio sink, e.g.
+ *
+ * > drummachine_headless -o beat.wav -l 8          offline render of 8 loops to beat.wav
+ * > drummachine_headless -s 5 -o live.wav          play for 5 s, recording the sink's output
+ * > drummachine_headless -s 60 -f                  free-running null sink, reports its speed
+ * > drummachine_headless -r 44100 -o beat.wav      as on a 44.1kHz device, samples are resampled
+ * > drummachine_headless -v 4:1 -o beat.wav        the hihat chokes itself, one voice
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "DrumMachine.h"
+#include "audio/FileSampleProvider.h"
+#include "audio/NullAudioSink.h"
+
+#ifndef DRUMMACHINE_DEFAULT_KIT_DIR
+#define DRUMMACHINE_DEFAULT_KIT_DIR "app/src/main/assets"
+#endif
+
+constexpr int kKickTrack = 0;
+constexpr int kHihatTrack = 4;
+constexpr int kSnareTrack = 7;
+
+static void printUsage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [-k kit_dir] [-t tempo] [-l loops] [-s seconds] [-f] [-m] [-r rate] [-v track:voices[:q]]\n"
+            "       [-o out.wav]\n"
+            "  -k  directory with the kit samples (default %s)\n"
+            "  -t  tempo in bpm (default 100)\n"
+            "  -l  loops to render offline (default 4)\n"
+            "  -s  play live through the null audio sink for this long instead\n"
+            "  -f  don't pace the null audio sink to real time\n"
+            "  -m  stream long and ADPCM samples instead of decoding them into memory\n"
+            "  -r  native sample rate of the null audio sink (default %d)\n"
+            "  -v  voices of a track, q to cut the quietest rather than the oldest (default %d)\n"
+            "  -o  WAV file to write the output to\n",
+            program, DRUMMACHINE_DEFAULT_KIT_DIR, kDefaultSampleRateHz,
+            kDefaultMaxVoices);
+}
+
+/**
+ * Apply a -v option, e.g. 4:1 or 3:8:q
+ *
+ * @return false if it can't be parsed or the drum machine rejects it
+ */
+static bool parseTrackVoices(DrumMachine &drumMachine, const char *option) {
+    int trackIdx = 0;
+    int maxVoices = 0;
+    char policy = 'o';
+    if (sscanf(option, "%d:%d:%c", &trackIdx, &maxVoices, &policy) < 2) return false;
+    VoiceStealPolicy stealPolicy = policy == 'q' ? VoiceStealPolicy::Quietest
+                                                 : VoiceStealPolicy::Oldest;
+    return drumMachine.setTrackVoices(trackIdx, maxVoices, stealPolicy);
+}
+
+/**
+ * One bar of sixteenth notes: kick on the beat, snare on 2 and 4, accented hihats panned right
+ */
+static void programDemoPattern(DrumMachine &drumMachine) {
+    drumMachine.setPatternGeometry(16, 4, kDefaultNumPatternTracks);
+    for (int step = 0; step < 16; step++) {
+        if (step % 4 == 0) drumMachine.addBeat(kKickTrack, step);
+        if (step % 8 == 4) drumMachine.addBeat(kSnareTrack, step);
+        if (step % 2 == 0) {
+            drumMachine.addBeat(kHihatTrack, step, step % 4 == 0 ? kMaxVelocity : 64, 96);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    std::string kitDir = DRUMMACHINE_DEFAULT_KIT_DIR;
+    std::string outputPath;
+    int tempo = 100;
+    int numLoops = 4;
+    double liveSeconds = 0;
+    bool isRealtime = true;
+    bool isMapped = false;
+    int sampleRate = kDefaultSampleRateHz;
+    std::vector<std::string> trackVoices;
+
+    int option;
+    while ((option = getopt(argc, argv, "k:t:l:s:fmr:v:o:h")) != -1) {
+        switch (option) {
+            case 'k': kitDir = optarg; break;
+            case 't': tempo = atoi(optarg); break;
+            case 'l': numLoops = atoi(optarg); break;
+            case 's': liveSeconds = atof(optarg); break;
+            case 'f': isRealtime = false; break;
+            case 'm': isMapped = true; break;
+            case 'r': sampleRate = atoi(optarg); break;
+            case 'v': trackVoices.push_back(optarg); break;
+            case 'o': outputPath = optarg; break;
+            default:
+                printUsage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    bool isLive = liveSeconds > 0;
+    auto *audioSink = new NullAudioSink(isRealtime, isLive ? outputPath : "", sampleRate);
+    auto prefetcher = isMapped ? std::make_shared<SamplePrefetcher>() : nullptr;
+    DrumMachine drumMachine(std::make_unique<FileSampleProvider>(kitDir, prefetcher),
+                            std::unique_ptr<AudioSink>(audioSink));
+    for (const std::string &voices : trackVoices) {
+        if (!parseTrackVoices(drumMachine, voices.c_str())) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    KitLoadReport kit = drumMachine.init();
+    if (!kit.isComplete()) return 1;
+    printf("loaded %zu samples in %.1f ms on %d threads, %zu of %zu KB resident, "
+           "tails fill in %.1f ms\n", kit.samples.size(), kit.totalMillis, kit.numThreads,
+           kit.residentBytes / 1024, kit.decodedBytes / 1024, kit.tailFillMillis);
+    programDemoPattern(drumMachine);
+
+    if (isLive) {
+        auto startTime = std::chrono::steady_clock::now();
+        drumMachine.start(tempo, 0);
+        if (!audioSink->isRunning()) return 1;
+        std::this_thread::sleep_for(std::chrono::duration<double>(liveSeconds));
+        drumMachine.stop();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        double audioSeconds = static_cast<double>(audioSink->getFramesRendered()) / sampleRate;
+        printf("played %.2f s of audio in %.2f s, %.1fx real time\n", audioSeconds, elapsed,
+               audioSeconds / elapsed);
+        printf("%s\n", drumMachine.getCallbackStats().toString().c_str());
+        return 0;
+    }
+
+    OfflineRenderResult result;
+    bool isRendered = outputPath.empty()
+            ? drumMachine.renderOffline(tempo, numLoops, [](const int16_t *, int32_t) {}, &result)
+            : drumMachine.exportWav(outputPath.c_str(), tempo, numLoops, &result);
+    if (!isRendered) return 1;
+    printf("rendered %lld frames in %.3f s, %.1fx real time\n",
+           static_cast<long long>(result.numFrames), result.renderSeconds, result.realtimeMultiple);
+    return 0;
+}
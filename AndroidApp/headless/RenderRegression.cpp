@@ -0,0 +1,138 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Regression renders of the drum machine. Each case programs a pattern, renders a few loops
+ * offline and counts the hits that can be heard, so timing bugs which drop or double a hit show up
+ * without listening to the output. Built by the host CMake build and run by ctest, e.g.
+ *
+ * > cmake -S . -B build && cmake --build build && ctest --test-dir build
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "DrumMachine.h"
+#include "audio/NullAudioSink.h"
+#include "audio/Player.h"
+
+constexpr int32_t kClickFrames = 64; // much shorter than a step at any tempo the cases use
+
+/**
+ * A short burst of full scale, so every hit is an onset after silence
+ */
+class ClickDataSource : public DataSource {
+public:
+    ClickDataSource() : mBuffer(kClickFrames * kChannelCount, INT16_MAX / 2) {}
+
+    int32_t getTotalFrames() const override { return kClickFrames; }
+    int32_t getChannelCount() const override { return kChannelCount; }
+    const int16_t* getData() const override { return mBuffer.data(); }
+
+private:
+    std::vector<int16_t> mBuffer;
+};
+
+class ClickSampleProvider : public SampleProvider {
+public:
+    std::shared_ptr<DataSource> loadSample(const std::string &, int32_t, int32_t) override {
+        return std::make_shared<ClickDataSource>();
+    }
+};
+
+/**
+ * @return the number of times the left channel goes from silence to sound
+ */
+static int countOnsets(const std::vector<int16_t> &audio) {
+    int numOnsets = 0;
+    bool wasSilent = true;
+    for (size_t i = 0; i < audio.size(); i += kChannelCount) {
+        bool isSilent = audio[i] == 0;
+        if (wasSilent && !isSilent) numOnsets++;
+        wasSilent = isSilent;
+    }
+    return numOnsets;
+}
+
+/**
+ * Render numLoops loops of a 16 step pattern with four steps per beat
+ *
+ * @param steps - steps which track 0 plays on
+ * @param swing - see Groove
+ * @param microTiming - offset of every step, see Groove
+ * @return whether the expected number of onsets was heard
+ */
+static bool checkOnsets(const char *name, const std::vector<int> &steps, int swing,
+                        const std::vector<int16_t> &microTiming, int numLoops,
+                        int expectedOnsets) {
+    constexpr int kTempo = 120;
+    DrumMachine drumMachine(std::make_unique<ClickSampleProvider>(),
+                            std::make_unique<NullAudioSink>(false, "", kDefaultSampleRateHz));
+    if (!drumMachine.init().isComplete()) return false;
+    drumMachine.setPatternGeometry(16, 4, kDefaultNumPatternTracks);
+    drumMachine.setGroove(swing, microTiming.data(), static_cast<int>(microTiming.size()));
+    for (int step : steps) {
+        drumMachine.addBeat(0, step);
+    }
+
+    std::vector<int16_t> audio;
+    if (!drumMachine.renderToBuffer(kTempo, numLoops, audio)) return false;
+    int numOnsets = countOnsets(audio);
+    bool isPassed = numOnsets == expectedOnsets;
+    printf("%s: %s, %d onsets, expected %d\n", isPassed ? "PASS" : "FAIL", name, numOnsets,
+           expectedOnsets);
+    return isPassed;
+}
+
+/**
+ * Hits of one Player which arrive before the same render must each get a voice of their own
+ */
+static bool checkCoincidingHits() {
+    auto source = std::make_shared<ClickDataSource>();
+    std::vector<int16_t> single(kClickFrames * kChannelCount);
+    Player singlePlayer(source);
+    singlePlayer.trigger();
+    singlePlayer.renderAudio(single.data(), kClickFrames);
+
+    std::vector<int16_t> doubled(kClickFrames * kChannelCount);
+    Player doubledPlayer(source);
+    doubledPlayer.trigger();
+    doubledPlayer.trigger();
+    doubledPlayer.renderAudio(doubled.data(), kClickFrames);
+
+    bool isPassed = single[0] != 0 && std::abs(doubled[0] - 2 * single[0]) <= 1;
+    printf("%s: coinciding hits, level %d, expected %d\n", isPassed ? "PASS" : "FAIL", doubled[0],
+           2 * single[0]);
+    return isPassed;
+}
+
+int main() {
+    std::vector<int16_t> lateLastStep(16, 0);
+    lateLastStep[15] = kMaxMicroTiming;
+    std::vector<int16_t> earlyFirstStep(16, 0);
+    earlyFirstStep[0] = -kMaxMicroTiming;
+
+    bool isPassed = true;
+    isPassed &= checkOnsets("straight", {0, 4, 8, 12}, kStraightSwing, {}, 3, 12);
+    // swing and micro-timing push the last step a whole step late, onto the end of the loop
+    isPassed &= checkOnsets("late last step", {8, 15}, kMaxSwing, lateLastStep, 3, 6);
+    isPassed &= checkOnsets("early first step", {0, 8}, kStraightSwing, earlyFirstStep, 3, 6);
+    isPassed &= checkCoincidingHits();
+    return isPassed ? 0 : 1;
+}